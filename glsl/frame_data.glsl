@@ -0,0 +1,11 @@
+// Per-frame and per-view data (FrameData in main.cpp)
+// Prepended by compileShader() to the shaders that read it, so every stage
+// declares the same std140 layout.
+layout(std140) uniform FrameData {
+	mat4 xform;				// Transformation matrix of the current view
+	mat4 lightViewXform;	// Light space transformation matrix
+	vec3 lightDir;
+	float time;				// Seconds since startup
+	vec3 camPos;			// World space camera position
+	vec4 clipPlane;			// Clip plane of the current view
+};
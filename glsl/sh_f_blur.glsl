@@ -0,0 +1,27 @@
+#version 330
+
+smooth in vec2 fragTC;		// Interpolated texture coordinates
+
+uniform sampler2D image;	// Caustics map (r: intensity, g: depth)
+uniform vec2 direction;		// Blur direction, in texels per tap step
+uniform float scale;		// Factor applied to the blurred intensity
+uniform float weight;		// Blend weight against the target's previous contents
+
+out vec4 outCol;	// Final pixel color
+
+// One direction of a separable 9-tap Gaussian, folded into 5 bilinear fetches
+void main() {
+	vec2 texel = 1.0f / vec2(textureSize(image, 0));
+	vec2 off1 = vec2(1.3846153846) * direction * texel;
+	vec2 off2 = vec2(3.2307692308) * direction * texel;
+
+	vec2 center = texture(image, fragTC).rg;
+	float intensity = center.r * 0.2270270270;
+	intensity += texture(image, fragTC + off1).r * 0.3162162162;
+	intensity += texture(image, fragTC - off1).r * 0.3162162162;
+	intensity += texture(image, fragTC + off2).r * 0.0702702703;
+	intensity += texture(image, fragTC - off2).r * 0.0702702703;
+
+	// The depth is passed on unfiltered for the shadow test (and written without blending)
+	outCol = vec4(intensity * scale, center.g, 0.0f, weight);
+}
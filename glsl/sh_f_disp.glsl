@@ -5,7 +5,11 @@ smooth in vec2 fragTCOut;		// Interpolated texture coordinates
 flat in int mtrlOut;
 in vec4 screenPosOut;
 in vec3 skyboxTCOut;
+#ifdef NO_GEOMETRY_SHADER
+in vec3 worldPosOut;	// World space position (for the flat face normal)
+#else
 in vec3 normal;
+#endif
 in vec3 eyePosOut;
 in vec3 lightViewPosOut;
 
@@ -16,8 +20,7 @@ uniform sampler2D refractionTex;
 uniform sampler2D reflectionTex;
 uniform samplerCube skybox;
 uniform sampler2D causticsTex;
-
-uniform vec3 lightDir;
+uniform sampler2D normalTex;
 
 out vec4 outCol;	// Final pixel color
 
@@ -27,56 +30,87 @@ const int MAT_WALL = 3;
 const int MAT_SKYBOX = 4;
 const int MAT_TERR = 5;
 
-float blur(sampler2D image, vec2 uv, vec2 resolution, vec2 direction) {
-	float intensity = 0.;
-	vec2 off1 = vec2(1.3846153846) * direction;
-	vec2 off2 = vec2(3.2307692308) * direction;
-	intensity += texture2D(image, uv).x * 0.2270270270;
-	intensity += texture2D(image, uv + (off1 / resolution)).x * 0.3162162162;
-	intensity += texture2D(image, uv - (off1 / resolution)).x * 0.3162162162;
-	intensity += texture2D(image, uv + (off2 / resolution)).x * 0.0702702703;
-	intensity += texture2D(image, uv - (off2 / resolution)).x * 0.0702702703;
-	return intensity;
-}
-
-float causticsIntensity() {
+float causticsIntensity(vec3 normal) {
 	float lightIntensity = 0.2f;
-	float causticsDepth = texture2D(causticsTex, lightViewPosOut.xy).g;
+	// Caustics map blurred once per frame (r: intensity, g: depth)
+	vec2 caustics = texture2D(causticsTex, lightViewPosOut.xy).rg;
 
-	if (causticsDepth > lightViewPosOut.z - 0.005f) {
+	if (caustics.g > lightViewPosOut.z - 0.005f) {
 		lightIntensity = -dot(lightDir, normal) * 0.5f;
-		float causticsIntensity = 1.0f * (
-			blur(causticsTex, lightViewPosOut.xy, vec2(512), vec2(0., 0.5)) +
-			blur(causticsTex, lightViewPosOut.xy, vec2(512), vec2(0.5, 0.)));
-		lightIntensity += causticsIntensity;
+		lightIntensity += caustics.r;
 	}
 	return lightIntensity;
 }
 
+// Cubic B-spline filtered lookup from four bilinear fetches
+vec4 textureBicubic(sampler2D tex, vec2 uv) {
+	vec2 size = vec2(textureSize(tex, 0));
+	vec2 st = uv * size - 0.5f;
+	vec2 i = floor(st);
+	vec2 f = st - i;
+
+	vec2 f2 = f * f, f3 = f2 * f;
+	vec2 w0 = (1.0f - 3.0f * f + 3.0f * f2 - f3) / 6.0f;
+	vec2 w1 = (4.0f - 6.0f * f2 + 3.0f * f3) / 6.0f;
+	vec2 w2 = (1.0f + 3.0f * f + 3.0f * f2 - 3.0f * f3) / 6.0f;
+	vec2 w3 = f3 / 6.0f;
+
+	// Each pair of taps becomes one bilinear fetch between them
+	vec2 g0 = w0 + w1;
+	vec2 g1 = w2 + w3;
+	vec2 h0 = (i - 0.5f + w1 / g0) / size;
+	vec2 h1 = (i + 1.5f + w3 / g1) / size;
+
+	return g0.y * (g0.x * textureLod(tex, vec2(h0.x, h0.y), 0.0f) + g1.x * textureLod(tex, vec2(h1.x, h0.y), 0.0f))
+		+ g1.y * (g0.x * textureLod(tex, vec2(h0.x, h1.y), 0.0f) + g1.x * textureLod(tex, vec2(h1.x, h1.y), 0.0f));
+}
+
+// Screen-space target lookup; targets rendered at under half the screen resolution
+// (dynamic resolution) are upsampled with the smoother cubic filter
+vec4 screenTexture(sampler2D tex, vec2 uv, vec2 texelsPerPixel) {
+	if (max(texelsPerPixel.x, texelsPerPixel.y) < 0.5f)
+		return textureBicubic(tex, uv);
+	return textureLod(tex, uv, 0.0f);
+}
+
 void main() {
+#ifdef NO_GEOMETRY_SHADER
+	// Flat face normal, first turned towards the eye (the sign of dFdy depends on the framebuffer),
+	// then oriented like the winding order normal of sh_g_disp.glsl (front faces are clockwise)
+	vec3 normal = normalize(cross(dFdx(worldPosOut), dFdy(worldPosOut)));
+	if (dot(normal, eyePosOut) < 0.0f)
+		normal = -normal;
+	if (gl_FrontFacing)
+		normal = -normal;
+#endif
+
 	vec3 waterColor = vec3(0.1f, 0.43f, 0.5f);
 
+#ifdef MATERIAL
+	switch (MATERIAL) {		// Program specialized for one material
+#else
 	switch (mtrlOut) {
+#endif
 		case MAT_WATER_SURF:
 		{
-			vec4 tangent = vec4(1.0f, 0.0f, 0.0f, 0.0f);
-			vec4 viewNormal = vec4(0.0f, 1.0f, 0.0f, 0.0f);
-			vec4 bitangent = vec4(0.0f, 0.0f, 1.0f, 0.0f);
-			vec4 viewDir = normalize(vec4(eyePosOut, 1.0f));
-			vec4 viewTanSpace = normalize(vec4(dot(viewDir, tangent), dot(viewDir, bitangent),
-			dot(viewDir, viewNormal), 1.0f));
-			vec4 viewReflection = normalize(reflect(-1.0f * viewTanSpace, vec4(normal, 1.0f)));
-			float fresnel = dot(vec4(normal, 1.0f), viewReflection);
+			// Per-pixel normal from the height gradient, scaled to world units
+			float slopeScale = 0.16f * float(textureSize(waterTex, 0).x) * 0.5f;
+			vec2 gradient = texture2D(normalTex, fragTCOut).rg * slopeScale;
+			vec3 normal = normalize(vec3(-gradient.x, 1.0f, -gradient.y));
+
+			// More light is refracted the steeper the view (the original tangent-space
+			// term was fed the clip-space position, as camPos was never set)
+			vec3 viewDir = normalize(eyePosOut);
+			float fresnel = clamp(dot(normal, viewDir), 0.0f, 1.0f);
 
 			vec2 refractCoord = screenPosOut.xy / screenPosOut.w / 2.0f + 0.5f;
 			vec2 reflectCoord = refractCoord;
 			reflectCoord.y = 1.0f - refractCoord.y;
 			vec4 offset = vec4(normal, 1.0f) * 0.05f;
-			vec4 refraction = texture2D(refractionTex, refractCoord + offset.xz);
+			vec2 screenStep = fwidth(refractCoord);
+			vec4 refraction = screenTexture(refractionTex, refractCoord + offset.xz, screenStep * vec2(textureSize(refractionTex, 0)));
 			refraction = mix(refraction, vec4(waterColor, 1.0f), 0.8f);
-			vec4 reflection = texture2D(reflectionTex, reflectCoord + offset.xz);
-
-			vec3 specular = vec3(clamp(pow(dot(viewTanSpace, vec4(normal, 1.0f)), 255.0), 0.0, 1.0)) * 2.5f;
+			vec4 reflection = screenTexture(reflectionTex, reflectCoord + offset.xz, screenStep * vec2(textureSize(reflectionTex, 0)));
 
 			outCol = mix(reflection, refraction, fresnel);
 			break;
@@ -90,7 +124,7 @@ void main() {
 
 		case MAT_WALL:
 		{
-			vec3 color = texture2D(wallTex, fragTCOut).xyz * causticsIntensity();
+			vec3 color = texture2D(wallTex, fragTCOut).xyz * causticsIntensity(normal);
 			outCol = vec4(color, 1.0f);
 			break;
 		}
@@ -103,14 +137,14 @@ void main() {
 
 		case MAT_TERR:
 		{
-			vec3 color = texture2D(terrTex, fragTCOut).xyz * 0.7f * causticsIntensity();
+			vec3 color = texture2D(terrTex, fragTCOut).xyz * 0.7f * causticsIntensity(normal);
 			outCol = vec4(color, 1.0f);
 			break;
 		}
 
 		case 0:
 		{
-			vec3 color = vec3(1.0f) * causticsIntensity();
+			vec3 color = vec3(1.0f) * causticsIntensity(normal);
 			outCol = vec4(color, 1.0f);
 			break;
 		}
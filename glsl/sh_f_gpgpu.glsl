@@ -70,11 +70,6 @@ void main() {
 	if (islandTexel < 0.5f)
 		offset = 0.0f;
 
-	coord = texelCoord + ivec2(4, 0);
-	vec3 ddx = vec3(4.0f, texelFetch(prevTex, coord, 0).r - offset, 0.0f);
-	coord = texelCoord + ivec2(0, 4);
-	vec3 ddy = vec3(0.0f, texelFetch(prevTex, coord, 0).r - offset, 4.0f);
-	vec2 normal = normalize(cross(ddy, ddx)).xz;
-
-	outCol = vec4(offset, normal, 1.0f);
+	// Only the height is written here, normals are derived in a separate pass
+	outCol = vec4(offset, 0.0f, 0.0f, 1.0f);
 }
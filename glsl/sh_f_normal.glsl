@@ -0,0 +1,22 @@
+#version 330
+
+smooth in vec2 fragTC;		// Interpolated texture coordinates
+
+uniform sampler2D waterTex;	// Water height texture
+
+out vec4 outCol;	// Final pixel color
+
+void main() {
+	// Central differences over the same 4-texel span as the wave equation
+	vec2 texel = 2.0f / vec2(textureSize(waterTex, 0));
+
+	float l = texture(waterTex, fragTC - vec2(texel.x, 0.0f)).r;
+	float r = texture(waterTex, fragTC + vec2(texel.x, 0.0f)).r;
+	float t = texture(waterTex, fragTC - vec2(0.0f, texel.y)).r;
+	float b = texture(waterTex, fragTC + vec2(0.0f, texel.y)).r;
+
+	// Height gradient per water texel (x along u, y along v)
+	vec2 gradient = vec2(r - l, b - t) * 0.25f;
+
+	outCol = vec4(gradient, 0.0f, 1.0f);
+}
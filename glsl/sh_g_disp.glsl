@@ -11,8 +11,6 @@ in vec3 skyboxTC[3];
 in vec3 eyePos[3];
 in vec3 lightViewPos[3];
 
-uniform vec4 clipPlane;
-
 smooth out vec2 fragTCOut;
 flat out int mtrlOut;
 out vec4 screenPosOut;
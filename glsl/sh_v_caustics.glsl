@@ -1,38 +1,44 @@
 #version 330
 
-layout(location = 0) in vec3 pos;		// Position
-layout(location = 1) in vec2 tc;		// Texture coordinates
-layout(location = 2) in int material;
-
-uniform mat4 xform;			// Transformation matrix
+uniform int photonGrid;		// Quads along each side of the photon grid
 
 uniform sampler2D waterTex;		// Texture samplers
 uniform sampler2D envTex;
-
-uniform vec3 lightDir;
+uniform sampler2D normalTex;
 
 out vec3 oldPos;
 out vec3 newPos;
 out float waterDepth;
 out float depth;
 
+// Corners of the two triangles of a grid quad
+const ivec2 QUAD_CORNERS[6] = ivec2[6](ivec2(0, 0), ivec2(0, 1), ivec2(1, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1));
+
+// Photon grid over the water surface, generated from gl_VertexID (six vertices per quad, row by row)
+vec2 photonGridVertex(int id) {
+	int quad = id / 6;
+	ivec2 cell = ivec2(quad % photonGrid, quad / photonGrid) + QUAD_CORNERS[id % 6];
+	return vec2(cell) / float(photonGrid) * 2.0f - 1.0f;
+}
+
 void main() {
-	vec4 worldPos = vec4(pos, 1.0f);
-	vec4 waterInfo = texture2D(waterTex, (worldPos.xz + 1.0f) * 0.5f);
-	float offset = waterInfo.r * 0.16f;
-	if (material == 1)
-		worldPos.y += offset;
-	vec3 normal = normalize(vec3(waterInfo.g, 1.0f, waterInfo.b)).xyz;
+	vec2 xz = photonGridVertex(gl_VertexID);
+	vec4 worldPos = vec4(xz.x, 0.0f, xz.y, 1.0f);
+	vec2 waterTC = (worldPos.xz + 1.0f) * 0.5f;
+	float offset = texture2D(waterTex, waterTC).r * 0.16f;
+	worldPos.y += offset;
+	vec2 gradient = texture2D(normalTex, waterTC).rg;
+	vec3 normal = normalize(vec3(-gradient.x, 1.0f, -gradient.y));
 
 	oldPos = worldPos.xyz;
 
-	vec4 screenPos = xform * worldPos;
+	vec4 screenPos = lightViewXform * worldPos;
 
 	vec2 currPos = screenPos.xy / screenPos.w;
 	vec2 coord = 0.5f + 0.5f * currPos;
 
 	vec3 refractedDir = refract(lightDir, normal, 0.7504f);
-	vec4 screenRefDir = xform * vec4(refractedDir, 1.0f);
+	vec4 screenRefDir = lightViewXform * vec4(refractedDir, 1.0f);
 	
 	waterDepth = 0.5f + 0.5f * screenPos.z / screenPos.w;
 	float currDepth = screenPos.z;
@@ -55,7 +61,7 @@ void main() {
 
 	newPos = env.xyz;
 
-	vec4 screenEnvPos = xform * vec4(newPos, 1.0f);
+	vec4 screenEnvPos = lightViewXform * vec4(newPos, 1.0f);
 	depth = 0.5f + 0.5f * screenEnvPos.z / screenEnvPos.w;
 
 	// Transform vertex position
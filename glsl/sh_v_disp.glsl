@@ -3,17 +3,17 @@
 layout(location = 0) in vec3 pos;		// Position
 layout(location = 1) in vec2 tc;		// Texture coordinates
 layout(location = 2) in int material;
+layout(location = 3) in vec4 patchInst;	// Water surface patch (origin x/z, size, morph end), zero size if none
 
 smooth out vec2 fragTC;		// Interpolated texture coordinate
 
-uniform mat4 xform;			// Transformation matrix
-uniform mat4 lightViewXform;
+uniform mat4 model;			// Model transformation (identity for static geometry)
+uniform int vertexSource;	// Where vertex positions come from (VERTEX_* below)
+uniform int waterBodyQuads;	// Quads along a water body side (VERTEX_WATER_BODY)
 
 uniform sampler2D waterTex;		// Texture samplers
 uniform sampler2D islandsTex;
 
-uniform vec3 camPos;
-
 flat out int mtrl;
 out vec4 worldPos;
 out vec4 screenPos;
@@ -21,17 +21,89 @@ out vec3 skyboxTC;
 out vec3 eyePos;
 out vec3 lightViewPos;
 
+#ifdef NO_GEOMETRY_SHADER
+// Fragment shader inputs (otherwise written by sh_g_disp.glsl)
+smooth out vec2 fragTCOut;
+flat out int mtrlOut;
+out vec4 screenPosOut;
+out vec3 skyboxTCOut;
+out vec3 eyePosOut;
+out vec3 lightViewPosOut;
+out vec3 worldPosOut;
+#endif
+
 const int MAT_WATER_SURF = 1;
 const int MAT_WATER = 2;
 const int MAT_TERR = 5;
 
+const int VERTEX_ATTRIBUTES = 0;	// Vertex buffer
+const int VERTEX_PATCH = 1;			// Surface patch grid generated from gl_VertexID
+const int VERTEX_WATER_BODY = 2;	// Water body generated from gl_VertexID
+
+// Corners of the two triangles of a grid quad (as in CdlodSurface's index buffer)
+const ivec2 QUAD_CORNERS[6] = ivec2[6](ivec2(0, 0), ivec2(0, 1), ivec2(1, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1));
+
+const float PATCH_QUADS = 32.0f;	// CdlodSurface::PATCH_QUADS
+
+// World x/z of a surface patch vertex, morphed towards the next coarser grid with distance
+vec2 patchPos(vec2 gridPos) {
+	vec2 xz = patchInst.xy + gridPos * patchInst.z;
+	float dist = distance(camPos, vec3(xz.x, 0.0f, xz.y));
+	float morph = clamp((dist - 0.7f * patchInst.w) / (0.3f * patchInst.w), 0.0f, 1.0f);
+	gridPos -= fract(gridPos * PATCH_QUADS * 0.5f) * 2.0f / PATCH_QUADS * morph;
+	return patchInst.xy + gridPos * patchInst.z;
+}
+
+// Patch grid position of a vertex, the quads ordered by quadrant like CdlodSurface's index buffer
+vec2 patchGridVertex(int id) {
+	const int HALF = int(PATCH_QUADS) / 2;
+	int quad = id / 6;
+	int quadrant = quad / (HALF * HALF);
+	int local = quad % (HALF * HALF);
+	ivec2 cell = ivec2(local % HALF + (quadrant & 1) * HALF, local / HALF + (quadrant >> 1) * HALF);
+	return vec2(cell + QUAD_CORNERS[id % 6]) / PATCH_QUADS;
+}
+
+// Water body vertex: the bottom quad, then waterBodyQuads quads along each side.
+// The sides reach up to the (displaced) surface; their last vertex of every
+// triangle is at the bottom, so the flat material is MAT_WATER.
+void waterBodyVertex(int id, out vec3 p, out int m) {
+	if (id < 6) {
+		vec2 xz = vec2(QUAD_CORNERS[id]) * 2.0f - 1.0f;
+		p = vec3(xz.x, -1.0f, xz.y);
+		m = MAT_WATER;
+		return;
+	}
+	id -= 6;
+	const ivec2 SIDE_CORNERS[6] = ivec2[6](ivec2(0, 1), ivec2(1, 1), ivec2(0, 0), ivec2(1, 1), ivec2(1, 0), ivec2(0, 0));
+	int side = id / (waterBodyQuads * 6);
+	ivec2 corner = SIDE_CORNERS[id % 6];
+	float t = float((id / 6) % waterBodyQuads + corner.x) / float(waterBodyQuads) * 2.0f - 1.0f;
+	vec2 xz = side == 0 ? vec2(t, -1.0f) : side == 1 ? vec2(1.0f, t) : side == 2 ? vec2(t, 1.0f) : vec2(-1.0f, t);
+	p = vec3(xz.x, corner.y == 1 ? 0.0f : -1.0f, xz.y);
+	m = corner.y == 1 ? MAT_WATER_SURF : MAT_WATER;
+}
+
 void main() {
-	worldPos = vec4(pos, 1.0f);
+	vec3 vertPos = pos;
+	vec2 vertTC = tc;
+	int vertMaterial = material;
+	if (patchInst.z > 0.0f) {
+		vec2 xz = patchPos(vertexSource == VERTEX_PATCH ? patchGridVertex(gl_VertexID) : pos.xz);
+		vertPos = vec3(xz.x, 0.0f, xz.y);
+		vertTC = (xz + 1.0f) * 0.5f;
+		vertMaterial = MAT_WATER_SURF;
+	}
+	else if (vertexSource == VERTEX_WATER_BODY) {
+		waterBodyVertex(gl_VertexID, vertPos, vertMaterial);
+		vertTC = (vertPos.xz + 1.0f) * 0.5f;
+	}
+	worldPos = model * vec4(vertPos, 1.0f);
 
-	mtrl = material;
+	mtrl = vertMaterial;
 
 	// Initial fix of water body/surface material interpolation
-	if (mtrl == MAT_WATER_SURF && pos.y != 0.0f)
+	if (mtrl == MAT_WATER_SURF && vertPos.y != 0.0f)
 		mtrl = MAT_WATER;
 
 	// Offset water surface
@@ -51,12 +123,28 @@ void main() {
 	gl_Position = screenPos;
 
 	// For water fresnel calculation
-	eyePos = camPos - screenPos.xyz;
+	eyePos = camPos - worldPos.xyz;
 
 	// Interpolate texture coordinates
-	fragTC = tc;
-	skyboxTC = pos;
+	fragTC = vertTC;
+	skyboxTC = vertPos;
 
 	vec4 lightViewPosW = lightViewXform * worldPos;
 	lightViewPos = 0.5f + lightViewPosW.xyz / lightViewPosW.w * 0.5f;
+
+#ifdef NO_GEOMETRY_SHADER
+	gl_ClipDistance[0] = dot(worldPos, clipPlane);
+
+	fragTCOut = fragTC;
+	mtrlOut = mtrl;
+	// Secondary fix of water body/surface material interpolation: the only surface
+	// vertices outside of the patches are the top edges of the water body sides
+	if (mtrl == MAT_WATER_SURF && patchInst.z == 0.0f)
+		mtrlOut = MAT_WATER;
+	screenPosOut = screenPos;
+	skyboxTCOut = skyboxTC;
+	eyePosOut = eyePos;
+	lightViewPosOut = lightViewPos;
+	worldPosOut = worldPos.xyz;
+#endif
 }
@@ -4,7 +4,7 @@ layout(location = 0) in vec3 pos;		// Position
 layout(location = 1) in vec2 tc;		// Texture coordinates
 layout(location = 2) in int material;
 
-uniform mat4 xform;			// Transformation matrix
+uniform mat4 model;			// Model transformation (identity for static geometry)
 
 uniform sampler2D islandsTex;		// Texture samplers
 
@@ -12,13 +12,13 @@ out vec3 worldPos;
 out float depth;
 
 void main() {
-	worldPos = pos;
+	worldPos = (model * vec4(pos, 1.0f)).xyz;
 	// Offset Terrain
 	if (material == 5) {
 		float offset = (1.0f - texture2D(islandsTex, (worldPos.xz + 1.0f) * 0.5f).r);
 		worldPos.y += offset;
 	}
-	vec4 screenPos = xform * vec4(worldPos, 1.0f);
+	vec4 screenPos = lightViewXform * vec4(worldPos, 1.0f);
 
 	// Transform vertex position
 	gl_Position = screenPos;
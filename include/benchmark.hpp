@@ -0,0 +1,92 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <glm/glm.hpp>
+#include "gpu_profiler.hpp"
+
+// Scripted benchmark run with frame time statistics
+// A scenario file lists camera moves and interactions by frame number, so
+// every run renders the same frames; the application plays back the events
+// and feeds the benchmark the CPU time of every frame and the GPU time of
+// every pass. Frames before the warmup count are left out of the statistics
+// (shader compilation, model loading, first uploads).
+//
+// Scenario lines ('#' starts a comment):
+//   frames N                    frames to render (default 600)
+//   warmup N                    frames left out of the statistics (default 30)
+//   seed N                      random seed of the terrain (default 1)
+//   F camera THETA PHI RADIUS   set the camera at frame F (degrees, distance)
+//   F orbit DTHETA DPHI DRADIUS camera motion per frame from frame F on
+//   F impulse U V [N]           press the water at texture coordinates U V for N frames (default 1)
+//   F terrain on|off            show or hide the terrain
+//   F reseed                    generate new terrain
+class Benchmark {
+public:
+	enum EventType { EVENT_CAMERA, EVENT_ORBIT, EVENT_IMPULSE, EVENT_RELEASE, EVENT_TERRAIN, EVENT_RESEED };
+
+	struct Event {
+		unsigned frame;
+		EventType type;
+		glm::vec3 value;	// Camera coordinates, orbit, impulse position or terrain switch (x)
+	};
+
+	// Throws std::runtime_error if the scenario cannot be read
+	Benchmark(const std::string& path);
+
+	unsigned frames() const { return frameCount; }
+	unsigned warmup() const { return warmupCount; }
+	unsigned seed() const { return rngSeed; }
+
+	// Events of a frame, in file order
+	std::vector<Event> events(unsigned frame) const;
+
+	// Run description written to the JSON summary (renderer, resolution, options)
+	void describe(const std::string& key, const std::string& value);
+
+	// Feed the statistics at the end of a frame (profiler may be NULL)
+	// The GPU times the profiler has just collected are those of latency - 1
+	// frames ago, so they are recorded against that frame.
+	void endFrame(unsigned frame, double cpuMs, const GpuProfiler* profiler);
+	// Frames to render until the GPU times of the last frame are collected too
+	unsigned framesToRender(const GpuProfiler* profiler) const;
+
+	// Frame time percentiles, frames and wave steps per second and the GPU time per pass
+	void report(std::ostream& out, int simSteps) const;
+	void writeJson(const std::string& path, int simSteps) const;
+
+protected:
+	struct Stats {
+		double minMs, averageMs, p50Ms, p95Ms, p99Ms, maxMs;
+	};
+
+	struct PassTimes {
+		std::string name;
+		std::vector<float> ms;		// One sample per measured frame (0 while the pass was skipped)
+	};
+
+	static Stats stats(std::vector<float> samples);
+
+	std::string path;
+	unsigned frameCount;
+	unsigned warmupCount;
+	unsigned rngSeed;
+	std::vector<Event> script;		// Sorted by frame
+	std::vector<std::pair<std::string, std::string>> description;
+
+	std::vector<float> frameMs;		// CPU time of the measured frames
+	std::vector<float> gpuFrameMs;	// Sum of all passes
+	std::vector<PassTimes> passes;
+	double measuredSeconds;
+
+private:
+	// Disallow copy and move
+	Benchmark(const Benchmark& other);
+	Benchmark(Benchmark&& other);
+	Benchmark& operator=(const Benchmark& other);
+	Benchmark& operator=(Benchmark&& other);
+};
+
+#endif
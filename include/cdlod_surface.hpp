@@ -0,0 +1,77 @@
+#ifndef CDLOD_SURFACE_HPP
+#define CDLOD_SURFACE_HPP
+
+#include <vector>
+#include <functional>
+#include <glm/glm.hpp>
+#include "gl_core_3_3.h"
+
+// Continuous level of detail (CDLOD) grid on the y = 0 plane
+// A quadtree over the surface picks, for each area, the coarsest patch
+// whose grid is still fine enough at its distance from the camera. All
+// patches share one grid mesh and are drawn instanced; vertices close to
+// the end of a level's range morph (in sh_v_disp.glsl) into the grid of
+// the next coarser level, so there are no popping or cracks between
+// levels. A procedural surface has no vertex or index buffer; the shader
+// derives the grid from gl_VertexID instead.
+class CdlodSurface {
+public:
+	// Patch instance (the first four floats are vertex attribute 3)
+	struct Patch {
+		glm::vec2 origin;	// Corner with the smallest x and z
+		float size;			// Edge length
+		float morphEnd;		// Camera distance where the grid is fully morphed to the next level
+		int quadrant;		// Quarter of the patch drawn (bit 0: +x half, bit 1: +z half), -1 for all
+	};
+
+	// Quads along a patch edge (the shaders use the same constant)
+	static const int PATCH_QUADS = 32;
+
+	// The finest level covers the distances up to finestRange, each level doubles it.
+	// heightRange bounds the vertical displacement (for the visibility test).
+	CdlodSurface(glm::vec2 origin, float size, float heightRange, int levels, float finestRange, int material, bool procedural = false);
+	~CdlodSurface() { release(); }
+
+	// Select the patches for a camera position (nodes failing the box test are skipped)
+	void select(const glm::vec3& camPos, std::vector<Patch>& patches,
+		std::function<bool(glm::vec3, glm::vec3)> boxVisible = nullptr) const;
+
+	void draw(const std::vector<Patch>& patches);
+
+	// Triangles of the full-resolution grid the finest level corresponds to
+	size_t fullGridTriangles() const;
+	// Triangles drawn since startup
+	size_t drawnTriangles() const { return trianglesDrawn; }
+
+	void release();		// Release OpenGL resources
+
+protected:
+	bool selectNode(glm::vec2 origin, float size, int level, const glm::vec3& camPos,
+		std::vector<Patch>& patches, const std::function<bool(glm::vec3, glm::vec3)>& boxVisible) const;
+
+	glm::vec2 origin;
+	float size;
+	int levels;
+	std::vector<float> ranges;		// Selection range of every level (0 is the finest)
+	float heightRange;				// Largest displacement from y = 0 (for the box test)
+	bool procedural;				// Grid vertices come from gl_VertexID
+
+	// OpenGL resources
+	GLuint vao;		// Vertex array object
+	GLuint vbuf;	// Grid vertex buffer (0 if procedural)
+	GLuint ibuf;	// Grid index buffer (0 if procedural)
+	GLuint instBuf;	// Patch instance buffer
+	GLsizei icount;	// Number of grid vertices drawn per patch (grouped by quadrant)
+
+	std::vector<Patch> sorted;	// Scratch array for draw()
+	size_t trianglesDrawn;
+
+private:
+	// Disallow copy and move
+	CdlodSurface(const CdlodSurface& other);
+	CdlodSurface(CdlodSurface&& other);
+	CdlodSurface& operator=(const CdlodSurface& other);
+	CdlodSurface& operator=(CdlodSurface&& other);
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef CPU_TRACE_HPP
+#define CPU_TRACE_HPP
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+// Scoped CPU time zones, exported as Chrome trace JSON (chrome://tracing, Perfetto)
+// Every thread records its zones into its own ring buffer; only the thread
+// owns the write position, so recording takes no lock. The newest RING_SIZE
+// zones of each thread are kept. While tracing is disabled a zone costs one
+// relaxed atomic load.
+class CpuTrace {
+public:
+	static const int NAME_SIZE = 48;
+	static const size_t RING_SIZE = 1 << 16;
+
+	// Zone from construction to destruction (names longer than NAME_SIZE - 1 are cut)
+	// A const char* name must outlive the scope (e.g. a literal); a std::string
+	// is copied, so temporaries such as concatenated labels are fine.
+	class Scope {
+	public:
+		Scope(const char* name) : name(name), begin(CpuTrace::enabled() ? now() : 0) {}
+		Scope(const std::string& name) : name(copy), begin(CpuTrace::enabled() ? now() : 0) {
+			if (!begin) return;
+			size_t length = name.copy(copy, NAME_SIZE - 1);
+			copy[length] = '\0';
+		}
+		~Scope() { if (begin) record(name, begin, now()); }
+
+	private:
+		const char* name;
+		uint64_t begin;		// 0 if tracing was disabled
+		char copy[NAME_SIZE];	// Name given as a std::string
+
+		// Disallow copy and move
+		Scope(const Scope& other);
+		Scope(Scope&& other);
+		Scope& operator=(const Scope& other);
+		Scope& operator=(Scope&& other);
+	};
+
+	static void enable(bool on) { active.store(on, std::memory_order_relaxed); }
+	static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+	// Write the zones recorded so far by all threads (zones still open are left out)
+	static void writeJson(const std::string& path);
+
+	// Nanoseconds since an arbitrary fixed point
+	static uint64_t now();
+
+protected:
+	static void record(const char* name, uint64_t begin, uint64_t end);
+
+	static std::atomic<bool> active;
+};
+
+// Trace the rest of the enclosing block
+#define CPU_TRACE_CONCAT2(a, b) a##b
+#define CPU_TRACE_CONCAT(a, b) CPU_TRACE_CONCAT2(a, b)
+#define CPU_TRACE_SCOPE(name) CpuTrace::Scope CPU_TRACE_CONCAT(cpuTraceScope, __LINE__)(name)
+
+#endif
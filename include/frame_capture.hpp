@@ -0,0 +1,97 @@
+#ifndef FRAME_CAPTURE_HPP
+#define FRAME_CAPTURE_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include "gl_core_3_3.h"
+
+// Saves every rendered frame as a numbered image file without stalling the renderer
+// capture() starts an asynchronous read of the frame into a pixel buffer object
+// of a ring and fences it. Later captures poll the fences without waiting: the
+// pixels of finished readbacks are copied out into a bounded queue, from which a
+// pool of encoder threads compresses and writes the files. Unfinished readbacks
+// stay in the ring, which grows if the GPU is behind all of its buffers. The
+// render thread only waits if the queue is full (the encoders or the disk are behind).
+class FrameCapture {
+public:
+	enum Format { FORMAT_PNG, FORMAT_PPM };
+
+	// Files are named <prefix>_<frame number>.<png|ppm>; encoders 0 picks one per spare core
+	FrameCapture(const std::string& prefix, Format format, int ringSize = 3, size_t queueSize = 8, int encoders = 0);
+	~FrameCapture() { release(); }
+
+	// Queue the current contents of a framebuffer (0 for the default one)
+	void capture(GLuint framebuffer, GLsizei width, GLsizei height);
+	// Write out everything captured so far and stop the encoders
+	void finish();
+
+	// Frames written, frames per second sustained from the first capture
+	// to the last write, queue occupancy and time the render thread waited
+	void report(std::ostream& out) const;
+
+	void release();		// Release OpenGL resources and threads
+
+protected:
+	struct Job {
+		unsigned frame;
+		GLsizei width;
+		GLsizei height;
+		std::vector<unsigned char> pixels;	// RGBA, bottom row first
+	};
+
+	struct Slot {
+		GLuint pbo;
+		GLsync fence;		// Set while a readback is pending
+		unsigned frame;
+		GLsizei width;
+		GLsizei height;
+	};
+
+	bool finished(const Slot& slot) const;	// Whether a readback is done (does not wait)
+	void collect(Slot& slot);	// Queue the pixels of a finished readback
+	void push(Job&& job);
+	void encode();				// Encoder thread
+	bool write(const Job& job) const;	// False if the file could not be written
+
+	std::string prefix;
+	Format format;
+	size_t queueSize;
+	size_t ringSize;			// Pixel buffers created
+	std::deque<Slot> pending;	// Readbacks in flight, oldest first
+	std::vector<Slot> spare;	// Pixel buffers free for the next capture
+	unsigned frames;			// Frames captured
+
+	// Queue shared with the encoders
+	std::vector<std::thread> encoders;
+	std::deque<Job> queue;
+	std::mutex queueMutex;
+	std::condition_variable queueNotEmpty;
+	std::condition_variable queueNotFull;
+	bool stopping;
+
+	// Statistics
+	std::atomic<unsigned> written;
+	std::atomic<unsigned> failed;
+	std::chrono::steady_clock::time_point firstCapture;
+	std::chrono::steady_clock::time_point lastWrite;	// Guarded by queueMutex
+	unsigned pushes;			// Frames queued
+	double occupancySum;		// Queue length seen by each push
+	size_t occupancyMax;
+	double waitSeconds;			// Render thread time spent on the full queue
+
+private:
+	// Disallow copy and move
+	FrameCapture(const FrameCapture& other);
+	FrameCapture(FrameCapture&& other);
+	FrameCapture& operator=(const FrameCapture& other);
+	FrameCapture& operator=(FrameCapture&& other);
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef GEOMETRY_ARENA_HPP
+#define GEOMETRY_ARENA_HPP
+
+#include <vector>
+#include "gl_core_3_3.h"
+
+// Static meshes sharing one vertex array, vertex buffer and index buffer
+// Meshes are sub-allocated from the arena before upload(); each one is
+// addressed by its index range and base vertex, so a list of meshes is
+// submitted with a single glMultiDrawElementsBaseVertex call.
+class GeometryArena {
+public:
+	// Sub-allocated mesh
+	struct Range {
+		GLsizei count;			// Number of indices
+		GLsizeiptr firstIndex;	// Offset into the index buffer (in indices)
+		GLint baseVertex;		// Offset added to every index
+	};
+
+	GeometryArena(GLsizei vertexSize);
+	~GeometryArena() { release(); }
+
+	// Vertex attribute (float data converted as by glVertexAttribPointer)
+	void addAttribute(GLuint index, GLint size, GLenum type, GLsizei offset);
+	// Integer vertex attribute (int/uint shader inputs, as by glVertexAttribIPointer)
+	void addIntAttribute(GLuint index, GLint size, GLenum type, GLsizei offset);
+
+	// Append a mesh (indices are relative to its first vertex)
+	Range add(const void* vertices, GLsizei vertexCount, const std::vector<GLuint>& indices);
+
+	// Create the OpenGL buffers and drop the CPU copies
+	void upload();
+
+	// Draw a list of meshes with one call
+	void draw(const std::vector<Range>& ranges, GLenum mode = GL_TRIANGLES);
+
+	GLuint vertexArray() const { return vao; }
+	GLsizeiptr vertexBytes() const { return vertexCount * vertexSize; }
+	GLsizeiptr indexBytes() const { return indexCount * GLsizeiptr(sizeof(GLuint)); }
+
+	void release();		// Release OpenGL resources
+
+protected:
+	struct Attribute {
+		GLuint index;
+		GLint size;
+		GLenum type;
+		GLsizei offset;
+		bool integer;	// Not converted to float
+	};
+
+	GLsizei vertexSize;
+	std::vector<Attribute> attributes;
+
+	// Staging data until upload()
+	std::vector<char> vertices;
+	std::vector<GLuint> indices;
+	GLsizeiptr vertexCount;
+	GLsizeiptr indexCount;
+
+	// OpenGL resources
+	GLuint vao;		// Vertex array object
+	GLuint vbuf;	// Vertex buffer
+	GLuint ibuf;	// Index buffer
+
+	// Scratch arrays for draw()
+	std::vector<GLsizei> counts;
+	std::vector<const GLvoid*> offsets;
+	std::vector<GLint> baseVertices;
+
+private:
+	// Disallow copy and move
+	GeometryArena(const GeometryArena& other);
+	GeometryArena(GeometryArena&& other);
+	GeometryArena& operator=(const GeometryArena& other);
+	GeometryArena& operator=(GeometryArena&& other);
+};
+
+#endif
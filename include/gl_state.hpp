@@ -0,0 +1,56 @@
+#ifndef GL_STATE_HPP
+#define GL_STATE_HPP
+
+#include <map>
+#include "gl_core_3_3.h"
+
+// Shadow copy of the OpenGL binding and capability state
+// Calls that would not change the current state are skipped (elided).
+// Code that changes the state behind its back must call invalidate(),
+// and deleted objects must be forgotten so that recycled names are rebound.
+class GLState {
+public:
+	static void useProgram(GLuint program);
+	static void bindVertexArray(GLuint vao);
+	static void bindFramebuffer(GLuint fbo);
+	static void bindTexture(GLuint unit, GLenum target, GLuint texture);
+	static void viewport(GLsizei width, GLsizei height);
+	static void enable(GLenum cap);
+	static void disable(GLenum cap);
+	static bool isEnabled(GLenum cap);		// Queried from OpenGL if not cached
+
+	// Forget cached state
+	static void invalidate();
+	static void forgetProgram(GLuint program);
+	static void forgetVertexArray(GLuint vao);
+	static void forgetFramebuffer(GLuint fbo);
+	static void forgetTexture(GLuint texture);
+
+	// Number of GL calls issued and elided
+	struct Counters {
+		unsigned issued;
+		unsigned elided;
+	};
+	static void endFrame();					// Start counting a new frame
+	static Counters frameCounters();		// Counters of the last finished frame
+	static Counters totalCounters();		// Counters since startup
+
+protected:
+	static const int MAX_UNITS = 16;
+	static const GLuint UNKNOWN = ~0u;
+
+	static GLuint program;
+	static GLuint vao;
+	static GLuint fbo;
+	static GLuint activeUnit;
+	static GLuint textures2D[MAX_UNITS];
+	static GLuint texturesCube[MAX_UNITS];
+	static GLsizei viewportW, viewportH;
+	static std::map<GLenum, bool> caps;
+
+	static Counters current;
+	static Counters last;
+	static Counters total;
+};
+
+#endif
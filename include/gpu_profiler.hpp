@@ -0,0 +1,83 @@
+#ifndef GPU_PROFILER_HPP
+#define GPU_PROFILER_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <fstream>
+#include "gl_core_3_3.h"
+
+// GPU time of named zones (e.g. render passes) per frame
+// Every zone is wrapped in a GL_TIME_ELAPSED query. Each frame uses its own
+// set of queries, which are read back framesInFlight frames later, when the
+// GPU has long finished them, so the CPU never waits for the results.
+// A zone entered several times in a frame adds up to one sample. The last
+// HISTORY samples of every zone are kept for rolling percentiles, and each
+// collected frame can be appended to a CSV log (frame, zone, milliseconds).
+class GpuProfiler {
+public:
+	GpuProfiler(int framesInFlight = 3);
+	~GpuProfiler() { release(); }
+
+	// Zones must not nest (only one time query may be active)
+	void begin(const std::string& name);
+	void end();
+	// Collect the results of the frame the queries of the next one are reused from
+	void endFrame();
+
+	// Zone names in order of first use
+	std::vector<std::string> zoneNames() const;
+	// Average GPU time per frame, in milliseconds
+	double averageMs(const std::string& name) const;
+	// GPU time in the last collected frame, in milliseconds (0 if the zone was not entered)
+	double lastMs(const std::string& name) const;
+	// Sum of all zones in the last collected frame, in milliseconds
+	double lastFrameMs() const { return lastFrameTotal; }
+	// Percentile (0 to 100) of the last HISTORY samples, in milliseconds
+	double percentileMs(const std::string& name, double percentile) const;
+
+	// Append every collected frame to a CSV file
+	void logCsv(const std::string& path);
+
+	// Frames between issuing a query and reading its result
+	int latency() const { return framesInFlight; }
+
+	// One line per zone with its average time and p50/p95/p99
+	void report(std::ostream& out) const;
+
+	void release();		// Release OpenGL resources
+
+protected:
+	struct Zone {
+		std::string name;
+		std::vector<std::vector<GLuint>> queries;	// Per frame slot, one per entry of the zone
+		std::vector<int> used;						// Queries issued per frame slot
+		double totalMs;
+		double lastMs;
+		unsigned samples;
+		std::vector<float> history;		// Ring of the last HISTORY samples
+	};
+
+	// Samples kept per zone for the percentiles
+	static const unsigned HISTORY = 256;
+
+	Zone* find(const std::string& name);
+	const Zone* find(const std::string& name) const;
+
+	int framesInFlight;
+	int slot;			// Frame slot of the current frame
+	unsigned framesCollected;
+	double lastFrameTotal;
+	std::vector<Zone> zones;
+	Zone* active;		// Zone between begin() and end()
+	std::ofstream csv;	// Per-frame log (if open)
+
+private:
+	// Disallow copy and move
+	GpuProfiler(const GpuProfiler& other);
+	GpuProfiler(GpuProfiler&& other);
+	GpuProfiler& operator=(const GpuProfiler& other);
+	GpuProfiler& operator=(GpuProfiler&& other);
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef INPUT_JOURNAL_HPP
+#define INPUT_JOURNAL_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <ostream>
+#include <cstdint>
+
+// Window input and the terrain seed, stamped with the simulation step counter
+// Recording writes every reshape, key, mouse and menu event with the number
+// of wave steps run before it. A replay hands the same events back at the
+// same steps, so the simulation goes through exactly the same states, and
+// ends at the step the recording ended.
+//
+// Text format, one entry per line:
+//   seed N
+//   STEP reshape W H | key KEY X Y | button BUTTON STATE X Y | move X Y | menu COMMAND
+//   STEP end
+class InputJournal {
+public:
+	enum Mode { MODE_RECORD, MODE_REPLAY };
+	enum EventType { EVENT_RESHAPE, EVENT_KEY, EVENT_MOUSE_BUTTON, EVENT_MOUSE_MOVE, EVENT_MENU };
+
+	struct Event {
+		EventType type;
+		int args[4];		// Callback arguments in order (unused ones 0)
+	};
+
+	// Record to a new file with the given seed, or load a recording to replay
+	// (throws std::runtime_error if the file cannot be opened or parsed)
+	InputJournal(const std::string& path, Mode mode, unsigned seed = 0);
+	~InputJournal() { release(); }
+
+	bool replaying() const { return mode == MODE_REPLAY; }
+	unsigned seed() const { return rngSeed; }
+
+	// Recording: append an event that arrived after the given number of steps
+	void record(uint64_t step, const Event& event);
+	// Replay: events due by the given step that have not been handed out yet
+	std::vector<Event> due(uint64_t step);
+	// Replay: whether the recording had ended by the given step
+	bool ended(uint64_t step) const { return step >= endStep; }
+	// Replay: window size of the first reshape (false if there is none)
+	bool initialSize(int& width, int& height) const;
+
+	// Recording: mark the end and close the file
+	void finish(uint64_t step);
+
+	// Events recorded or replayed so far
+	void report(std::ostream& out) const;
+
+	void release();		// Close the file
+
+protected:
+	struct Entry {
+		uint64_t step;
+		Event event;
+	};
+
+	std::string path;
+	Mode mode;
+	unsigned rngSeed;
+	std::ofstream out;				// Recording
+	std::vector<Entry> entries;		// Replay, in file order
+	size_t next;					// Replay: next entry to hand out
+	uint64_t endStep;				// Replay: step the recording ended at
+	uint64_t lastStep;				// Steps seen by record() or due()
+	unsigned events;				// Events recorded or replayed
+
+private:
+	// Disallow copy and move
+	InputJournal(const InputJournal& other);
+	InputJournal(InputJournal&& other);
+	InputJournal& operator=(const InputJournal& other);
+	InputJournal& operator=(InputJournal&& other);
+};
+
+#endif
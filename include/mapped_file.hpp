@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file (mmap, or a file mapping on Windows)
+// The pages are read on first access and shared with the page cache, so a
+// file can be parsed or handed to OpenGL without copying it into memory first.
+class MappedFile {
+public:
+	// Throws std::runtime_error if the file cannot be opened or mapped
+	MappedFile(const std::string& path);
+	~MappedFile() { release(); }
+
+	const char* begin() const { return data; }
+	const char* end() const { return data + size; }
+	size_t bytes() const { return size; }
+
+	void release();		// Unmap and close the file
+
+protected:
+	const char* data;	// NULL for an empty file
+	size_t size;
+#ifdef _WIN32
+	void* file;			// HANDLE
+	void* mapping;
+#else
+	int file;
+#endif
+
+private:
+	// Disallow copy and move
+	MappedFile(const MappedFile& other);
+	MappedFile(MappedFile&& other);
+	MappedFile& operator=(const MappedFile& other);
+	MappedFile& operator=(MappedFile&& other);
+};
+
+#endif
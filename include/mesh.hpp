@@ -4,12 +4,14 @@
 #include <string>
 #include <vector>
 #include <utility>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include "gl_core_3_3.h"
 
 class Mesh {
 public:
-	Mesh(std::string filename);
+	// A binary cache of the GPU buffers is kept next to the file (<filename>.cache)
+	Mesh(std::string filename, bool useCache = true);
 	~Mesh() { release(); }
 
 	// Return the bounding box of this object
@@ -19,11 +21,40 @@ public:
 	}
 
 	void load(std::string filename);
-	void draw();
+	void draw(GLint uniModel = -1, int level = 0);		// Sends the model matrix to uniModel if given
+
+	// Level of detail: a simplified copy of the mesh in a range of the index buffer
+	struct Level {
+		size_t firstIndex;
+		size_t triangles;
+		float error;		// Largest deviation from the full mesh, in model units
+	};
+	// Level 0 is the full mesh, every further level has about half the triangles
+	static const int MAX_LEVELS = 5;
+	int levelCount() const { return int(levels.size()); }
+	const Level& level(int i) const { return levels[i]; }
+	// Coarsest level whose error covers at most maxPixelError pixels at pixelsPerUnit
+	int selectLevel(float pixelsPerUnit, float maxPixelError) const;
+
+	// Whether the last load() skipped parsing, and how long it took in milliseconds
+	bool loadedFromCache() const { return fromCache; }
+	double loadMs() const { return loadTime; }
+
+	// Index buffer statistics
+	struct Stats {
+		size_t triangles;		// Of the full mesh
+		size_t vertices;		// Unique (position, normal) pairs
+		float acmrFileOrder;	// Average cache miss ratio of the triangles in file order
+		float acmrOptimized;	// and after reordering them for the vertex cache
+	};
+	const Stats& stats() const { return meshStats; }
 
 	void move(const float&, const float&, const float&);
 	void rotate(const float&, const float&, const float&);
 
+	// Model transformation (offset and rotation), applied on the GPU
+	glm::mat4 modelMatrix() const;
+
 	// Mesh vertex format
 	struct Vtx {
 		glm::vec3 pos;		// Position
@@ -34,7 +65,25 @@ public:
 	void getVerticesNorm(std::vector<glm::vec3>&, std::vector<unsigned int>&);
 
 protected:
+	// Size and modification time of the source file, identifying a cache
+	struct SourceStamp {
+		uint64_t size;
+		int64_t time;
+	};
+
 	void release();		// Release OpenGL resources
+	void updateTransformed();	// Transform m_vertices and m_normals on the CPU
+	void loadSource();			// Parse the OBJ file into the CPU-side arrays
+	void upload(const Vtx* vertices, size_t count, const unsigned int* indices, size_t indexCount);
+	// Build the indexed, cache-ordered vertex and index buffers from the CPU-side arrays
+	void buildIndexed(std::vector<Vtx>& vertices, std::vector<unsigned int>& indices);
+	// Simplify the full mesh into the further levels (in parallel) and append their indices
+	void buildLevels(const std::vector<Vtx>& vertices, std::vector<unsigned int>& indices);
+
+	// Binary cache: false if it is missing, stale or unreadable
+	bool loadCache(const std::string& path, const SourceStamp& stamp);
+	void writeCache(const std::string& path, const SourceStamp& stamp, const std::vector<Vtx>& vertices,
+		const std::vector<unsigned int>& indices) const;
 
 	// Bounding box
 	glm::vec3 minBB;
@@ -43,10 +92,19 @@ protected:
 	// OpenGL resources
 	GLuint vao;		// Vertex array object
 	GLuint vbuf;	// Vertex buffer
-	GLsizei vcount;	// Number of vertices
+	GLuint ibuf;	// Index buffer
+	GLsizei icount;	// Number of indices
+	Stats meshStats;
+	std::vector<Level> levels;
+
+	std::string source;		// OBJ file
+	bool useCache;
+	bool fromCache;			// The CPU-side arrays are only parsed on demand
+	double loadTime;		// Milliseconds
 
 	glm::vec3 currentOffset;
 	glm::vec3 currentRotation;
+	bool transformedDirty;		// m_vertices and m_normals are out of date
 	std::vector<glm::vec3> raw_vertices;
 	std::vector<glm::vec3> raw_normals;
 	std::vector<glm::vec3> m_vertices;
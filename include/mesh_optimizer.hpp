@@ -0,0 +1,24 @@
+#ifndef MESH_OPTIMIZER_HPP
+#define MESH_OPTIMIZER_HPP
+
+#include <vector>
+#include <cstddef>
+
+// Triangle and vertex order of indexed meshes
+
+// Reorder the triangles of an index buffer for the post-transform vertex
+// cache (Tom Forsyth's linear-speed optimization): triangles are emitted
+// greedily by the scores of their vertices, which favor vertices in a
+// simulated 32-entry LRU cache and vertices with few triangles left.
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+
+// Renumber the vertices in order of first use, so vertex fetches walk the
+// buffer forward. Rewrites the indices and returns the new index of every
+// old vertex (unused vertices go last); the caller moves the vertex data.
+std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount);
+
+// Average cache miss ratio: vertices transformed per triangle with a FIFO
+// post-transform cache of cacheSize entries (3 for no reuse, 0.5 at best)
+float averageCacheMissRatio(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize = 32);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef MESH_SIMPLIFIER_HPP
+#define MESH_SIMPLIFIER_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Reduce an indexed triangle mesh to about targetTriangles triangles by
+// quadric-error edge collapse (Garland and Heckbert). Vertices are collapsed
+// onto neighboring vertices, so the result indexes the same vertex buffer.
+// Vertices sharing a position (e.g. split by normals) are moved together and
+// represented by one of them. Open borders are kept in place, and
+// collapses that would flip a triangle are rejected, so the target may not
+// be reached. Returns the new indices; error receives the largest distance
+// (in model units) a collapse moved the surface by.
+std::vector<unsigned int> simplifyMesh(const std::vector<glm::vec3>& positions,
+	const std::vector<unsigned int>& indices, size_t targetTriangles, float& error);
+
+#endif
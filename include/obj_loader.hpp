@@ -0,0 +1,30 @@
+#ifndef OBJ_LOADER_HPP
+#define OBJ_LOADER_HPP
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Geometry of a Wavefront OBJ file (texture coordinates, groups and materials are skipped)
+struct ObjGeometry {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<unsigned int> positionIndices;	// Three per triangle, faces split into fans
+	std::vector<unsigned int> normalIndices;	// Three per triangle (none if the faces have no normals)
+	glm::vec3 minBB;							// Bounding box of the positions
+	glm::vec3 maxBB;
+};
+
+// Parse an OBJ file from a memory mapping with std::from_chars
+// The file is cut at line boundaries into chunks of at least a megabyte,
+// which are parsed in parallel (threads 0 uses one thread per core) and
+// merged in file order. Nothing is allocated per line; the output vectors
+// only grow. Throws std::runtime_error if the file cannot be read or holds
+// a malformed vertex or face.
+ObjGeometry loadObj(const std::string& path, int threads = 0);
+
+// The previous line-by-line loader (getline, string splitting, stof), kept
+// as the reference loadObj() is checked and benchmarked against
+ObjGeometry loadObjStream(const std::string& path);
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef RENDER_GRAPH_HPP
+#define RENDER_GRAPH_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include "gl_core_3_3.h"
+
+// Frame graph of render passes
+// Passes and the resources they read and write are declared every frame.
+// execute() orders the passes by their dependencies, culls the ones whose
+// outputs are never used, backs transient render targets with pooled
+// (and, where lifetimes allow, aliased) textures and binds each pass's
+// framebuffer and fixed-function state (through GLState) before running it.
+class RenderGraph {
+public:
+	typedef int Resource;
+
+	// Render target texture description
+	struct TextureDesc {
+		GLsizei width;
+		GLsizei height;
+		GLenum internalFormat;
+		GLenum format;
+		GLenum type;
+		bool mipmaps;		// Regenerate the mip chain after every write
+
+		bool operator==(const TextureDesc& other) const;
+	};
+
+	// Fixed-function state set up by the scheduler before a pass runs
+	struct PassState {
+		GLbitfield clearMask;	// Buffers cleared before the pass (0 for none)
+		bool blend;				// Alpha blending
+	};
+
+	typedef std::function<void()> PassFunc;
+	typedef std::function<void(const std::string&)> PassHook;
+
+	RenderGraph();
+	~RenderGraph() { release(); }
+
+	// Start declaring a new frame (forgets the previous frame's passes)
+	void beginFrame();
+
+	// Persistent texture owned by the caller
+	Resource importTexture(const std::string& name, GLuint texture, GLsizei width, GLsizei height);
+	// Default framebuffer (or the framebuffer object standing in for it)
+	Resource importBackbuffer(GLsizei width, GLsizei height, GLuint framebuffer = 0);
+	// Texture that only lives for this frame
+	Resource createTexture(const std::string& name, const TextureDesc& desc);
+	// Keep a resource (and everything it depends on) alive
+	void markOutput(Resource res);
+
+	// Each resource may be written by at most one pass per frame
+	void addPass(const std::string& name, const std::vector<Resource>& reads,
+		const std::vector<Resource>& writes, const PassState& state, PassFunc func);
+
+	void execute();
+
+	// Texture backing a resource (valid while the frame executes)
+	GLuint texture(Resource res) const;
+
+	// Called around every executed pass, e.g. for timing
+	void setPassHooks(PassHook begin, PassHook end);
+
+	// Statistics of the last executed frame
+	int executedPassCount() const { return executedPasses; }
+	int culledPassCount() const { return culledPasses; }
+	int pooledTextureCount() const { return int(pool.size()); }
+
+	void release();		// Release OpenGL resources
+
+protected:
+	struct ResourceNode {
+		std::string name;
+		TextureDesc desc;
+		bool imported;
+		bool output;
+		GLuint texture;
+		int writer;			// Pass writing this resource, -1 if none
+		int firstUse;		// Execution order range using the resource
+		int lastUse;
+	};
+
+	struct PassNode {
+		std::string name;
+		std::vector<Resource> reads;
+		std::vector<Resource> writes;
+		PassState state;
+		PassFunc func;
+	};
+
+	struct PooledTexture {
+		TextureDesc desc;
+		GLuint texture;
+		int freeFrom;			// First pass (in execution order) it is free again
+		unsigned lastFrame;		// Last frame the texture was used
+	};
+
+	std::vector<int> schedule();
+	void allocate(const std::vector<int>& order);
+	void bindTargets(const PassNode& pass);
+	GLuint framebuffer(const std::vector<GLuint>& attachments);
+
+	std::vector<ResourceNode> resources;
+	std::vector<PassNode> passes;
+	std::vector<PooledTexture> pool;
+	std::map<std::vector<GLuint>, GLuint> framebuffers;
+	GLuint backbuffer;		// Framebuffer of the imported backbuffer
+
+	PassHook beginHook;
+	PassHook endHook;
+
+	unsigned frame;
+	int executedPasses;
+	int culledPasses;
+
+private:
+	// Disallow copy and move
+	RenderGraph(const RenderGraph& other);
+	RenderGraph(RenderGraph&& other);
+	RenderGraph& operator=(const RenderGraph& other);
+	RenderGraph& operator=(RenderGraph&& other);
+};
+
+#endif
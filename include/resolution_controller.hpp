@@ -0,0 +1,39 @@
+#ifndef RESOLUTION_CONTROLLER_HPP
+#define RESOLUTION_CONTROLLER_HPP
+
+// Dynamic resolution scale holding a GPU frame time budget
+// Every frame it is fed the measured GPU frame time and the part of it spent
+// in passes whose cost grows with their render target size. Taking that cost
+// as proportional to the pixel count, it estimates the scale at which the
+// frame would just fit the budget and moves toward it. The scale is quantized
+// to steps so targets are only reallocated on real changes; it drops as soon
+// as the estimate falls below the current step but only grows again with a
+// step of headroom.
+class ResolutionController {
+public:
+	// latency: frames until a new scale shows up in the measurements
+	ResolutionController(double budgetMs, int latency, float minScale = 0.25f, float maxScale = 1.0f);
+
+	// Feed one frame's GPU times (in milliseconds)
+	void update(double frameMs, double scaledMs);
+
+	float scale() const { return current; }
+	double budget() const { return budgetMs; }
+	unsigned changes() const { return changeCount; }
+
+	// Number of scale steps between 0 and 1
+	static const int STEPS = 16;
+
+protected:
+	double budgetMs;
+	int latency;
+	float minScale;
+	float maxScale;
+
+	float current;		// Scale in use
+	float smoothed;		// Filtered estimate of the scale fitting the budget
+	int settle;			// Measurements left that still show the previous scale
+	unsigned changeCount;
+};
+
+#endif
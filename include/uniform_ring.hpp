@@ -0,0 +1,49 @@
+#ifndef UNIFORM_RING_HPP
+#define UNIFORM_RING_HPP
+
+#include <vector>
+#include "gl_core_3_3.h"
+
+// Ring of uniform buffer blocks shared by all shader programs
+// Every frame owns one region of the buffer holding a block per slot
+// (e.g. per view). The region is written once per frame and each draw only
+// binds the slot it needs. A fence per region keeps the CPU from
+// overwriting blocks the GPU may still be reading.
+class UniformRing {
+public:
+	UniformRing(GLuint binding, GLsizeiptr blockSize, int slotsPerFrame, int framesInFlight = 3);
+	~UniformRing() { release(); }
+
+	// Point a program's uniform block at this ring's binding (if it uses it)
+	void attach(GLuint program, const char* blockName) const;
+
+	// Write the blocks of all slots of a new frame
+	void update(const void* blocks);
+	// Bind one slot of the current frame
+	void bind(int slot);
+	// Fence the current frame once all of its draws were submitted
+	void endFrame();
+
+	void release();		// Release OpenGL resources
+
+protected:
+	GLuint binding;			// Uniform buffer binding point
+	GLsizeiptr blockSize;	// Size of one block
+	GLsizeiptr stride;		// Block size rounded up to the offset alignment
+	int slotsPerFrame;
+	int framesInFlight;
+
+	GLuint buffer;
+	std::vector<GLsync> fences;		// One per frame region, 0 if free
+	int frame;				// Region of the current frame
+	int boundSlot;			// Last bound slot of the current frame, -1 if none
+
+private:
+	// Disallow copy and move
+	UniformRing(const UniformRing& other);
+	UniformRing(UniformRing&& other);
+	UniformRing& operator=(const UniformRing& other);
+	UniformRing& operator=(UniformRing&& other);
+};
+
+#endif
@@ -5,6 +5,8 @@
 #include <vector>
 #include "gl_core_3_3.h"
 
+// Shader source text (e.g. a snippet to prepend to other shaders)
+std::string loadShaderSource(std::string filename);
 GLuint compileShader(GLenum type, std::string filename, std::string prepend = "");
 GLuint linkProgram(std::vector<GLuint> shaders);
 
@@ -0,0 +1,82 @@
+#ifndef WINDOW_HPP
+#define WINDOW_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "gl_core_3_3.h"
+
+// Window system the renderer runs in
+// A backend creates the OpenGL 3.3 core context, calls the application's
+// callbacks from run() until exit is requested and names the framebuffer
+// the final image goes to. The GLUT backend (USE_GLUT) shows a window with
+// mouse, keyboard and a context menu. The headless backend (USE_EGL) needs
+// no display or GPU (EGL on Mesa, e.g. llvmpipe): it renders into an
+// offscreen framebuffer object and runs the frames back to back, without
+// vsync or a compositor, until its frame limit.
+class Window {
+public:
+	// Mouse buttons and button states (same values as GLUT)
+	static const int BUTTON_LEFT = 0;
+	static const int BUTTON_MIDDLE = 1;
+	static const int BUTTON_RIGHT = 2;
+	static const int BUTTON_DOWN = 0;
+	static const int BUTTON_UP = 1;
+
+	// Application callbacks (entries may be NULL)
+	struct Callbacks {
+		void (*display)();
+		void (*reshape)(int width, int height);
+		void (*keyRelease)(unsigned char key, int x, int y);
+		void (*mouseButton)(int button, int state, int x, int y);
+		void (*mouseMove)(int x, int y);
+		void (*idle)();
+		void (*close)();	// Called once when the loop ends
+	};
+
+	// Context menu entry (a submenu if it has entries)
+	struct MenuEntry {
+		std::string label;
+		int command;
+		std::vector<MenuEntry> submenu;
+	};
+
+	virtual ~Window() {}
+
+	// Run the main loop until requestExit()
+	virtual void run(const Callbacks& callbacks) = 0;
+	virtual void requestExit() = 0;
+	// Ask for another display() call (the headless loop always makes one)
+	virtual void postRedisplay() {}
+	// Finish the frame
+	virtual void swapBuffers() = 0;
+
+	// Menu on the right mouse button, calling handler with the entry's command
+	virtual void setMenu(const std::vector<MenuEntry>& /*entries*/, void (* /*handler*/)(int)) {}
+	virtual void setTitle(const std::string& /*title*/) {}
+
+	// Seconds since the window was created
+	virtual double elapsedSeconds() const = 0;
+	// Framebuffer standing in for the default framebuffer
+	virtual GLuint framebuffer() const { return 0; }
+	// Frames finished by swapBuffers()
+	unsigned frameCount() const { return frames; }
+
+	// Backends (throw std::runtime_error if not built in)
+	static std::unique_ptr<Window> createGlut(int* argc, char** argv, int width, int height, const std::string& title);
+	static std::unique_ptr<Window> createHeadless(int width, int height, unsigned frameLimit);
+
+protected:
+	Window() : frames(0) {}
+
+	unsigned frames;
+
+private:
+	// Disallow copy and move
+	Window(const Window& other);
+	Window(Window&& other);
+	Window& operator=(const Window& other);
+	Window& operator=(Window&& other);
+};
+
+#endif
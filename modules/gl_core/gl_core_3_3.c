@@ -87,6 +87,9 @@ static PROC WinGetProcAddress(const char *name)
 	#else
 		#if defined(__sgi) || defined(__sun)
 			#define IntGetProcAddress(name) SunGetProcAddress(name)
+		#elif defined(GL_CORE_EGL) /* EGL without a window system */
+		    #include <EGL/egl.h>
+			#define IntGetProcAddress(name) eglGetProcAddress((const char*)name)
 		#else /* GLX */
 		    #include <GL/glx.h>
 
@@ -26,7 +26,9 @@
 #define __gltypes_h_
 #define __gl_ATI_h_
 
-#ifdef GLCORE_EXPORTS
+#if !defined(_WIN32)
+#	define GLCOREAPI
+#elif defined(GLCORE_EXPORTS)
 #	define GLCOREAPI __declspec(dllexport)
 #else
 #	define GLCOREAPI __declspec(dllimport)
@@ -0,0 +1,250 @@
+#include "benchmark.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+	void writeEscaped(std::ostream& out, const std::string& s) {
+		for (auto c = s.begin(); c != s.end(); ++c) {
+			if (*c == '"' || *c == '\\') out << '\\';
+			if ((unsigned char)*c >= 0x20) out << *c;
+		}
+	}
+
+	// Whole word as a number (nothing may follow it)
+	template <typename T> bool parseWord(const std::string& text, T& value) {
+		std::istringstream in(text);
+		return (in >> value) && in.eof();
+	}
+}
+
+Benchmark::Benchmark(const std::string& path) : path(path) {
+	frameCount = 600;
+	warmupCount = 30;
+	rngSeed = 1;
+	measuredSeconds = 0.0;
+
+	std::ifstream in(path);
+	if (!in)
+		throw std::runtime_error("Benchmark::Benchmark() - Cannot open " + path);
+
+	std::string line;
+	for (int lineNumber = 1; std::getline(in, line); lineNumber++) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream words(line);
+		std::string first;
+		if (!(words >> first)) continue;
+		auto fail = [&](const std::string& msg) {
+			return std::runtime_error("Benchmark::Benchmark() - " + path + ":" + std::to_string(lineNumber) + ": " + msg);
+		};
+
+		// Next word of the line, which must be there
+		auto next = [&](const std::string& missing) {
+			std::string text;
+			if (!(words >> text)) throw fail(missing);
+			return text;
+		};
+		long long maximum = std::numeric_limits<unsigned>::max();
+
+		// Settings
+		if (!std::isdigit((unsigned char)first[0])) {
+			if (first != "frames" && first != "warmup" && first != "seed")
+				throw fail("unknown setting " + first);
+			std::string text = next(first + " needs a number");
+			long long value;
+			if (!parseWord(text, value))
+				throw fail(first + " needs a number, got " + text);
+			long long minimum = first == "frames" ? 1 : 0;
+			if (value < minimum || value > maximum)
+				throw fail(first + " must be between " + std::to_string(minimum) + " and "
+					+ std::to_string(maximum) + ", got " + text);
+			if (words >> text)
+				throw fail(first + " takes one number, got " + text + " after it");
+			if (first == "frames") frameCount = unsigned(value);
+			else if (first == "warmup") warmupCount = unsigned(value);
+			else rngSeed = unsigned(value);
+			continue;
+		}
+
+		// Events
+		long long frame;
+		if (!parseWord(first, frame) || frame > maximum)
+			throw fail("event frame must be between 0 and " + std::to_string(maximum) + ", got " + first);
+		std::string command = next("event at frame " + first + " needs a command");
+		// Next word as a number
+		auto argument = [&](const std::string& what) {
+			std::string text = next(command + " needs " + what);
+			float value;
+			if (!parseWord(text, value))
+				throw fail(command + " needs " + what + ", got " + text);
+			return value;
+		};
+		Event e = { unsigned(frame), EVENT_CAMERA, glm::vec3(0.0f) };
+		if (command == "camera" || command == "orbit") {
+			e.type = command == "camera" ? EVENT_CAMERA : EVENT_ORBIT;
+			e.value.x = argument("three numbers");
+			e.value.y = argument("three numbers");
+			e.value.z = argument("three numbers");
+		}
+		else if (command == "impulse") {
+			for (int i = 0; i < 2; i++) {
+				std::string text = next("impulse needs texture coordinates");
+				if (!parseWord(text, e.value[i]) || e.value[i] < 0.0f || e.value[i] > 1.0f)
+					throw fail("impulse texture coordinates must be between 0 and 1, got " + text);
+			}
+			long long duration = 1;
+			std::string text;
+			if (words >> text) {
+				// Released within the frame counter's range
+				long long longest = maximum - frame;
+				if (!parseWord(text, duration) || duration < 1 || duration > longest)
+					throw fail("impulse frames must be between 1 and " + std::to_string(longest) + ", got " + text);
+			}
+			e.type = EVENT_IMPULSE;
+			script.push_back(e);
+			// Released like a mouse button after the given frames
+			e = { e.frame + unsigned(duration), EVENT_RELEASE, glm::vec3(0.0f) };
+		}
+		else if (command == "terrain") {
+			std::string state = next("terrain needs on or off");
+			if (state != "on" && state != "off")
+				throw fail("terrain needs on or off, got " + state);
+			e.type = EVENT_TERRAIN;
+			e.value.x = state == "on" ? 1.0f : 0.0f;
+		}
+		else if (command == "reseed")
+			e.type = EVENT_RESEED;
+		else throw fail("unknown command " + command);
+		std::string extra;
+		if (words >> extra)
+			throw fail(command + " has too many arguments, got " + extra);
+		script.push_back(e);
+	}
+
+	// Stable, so events of one frame keep their order
+	std::stable_sort(script.begin(), script.end(), [](const Event& a, const Event& b) { return a.frame < b.frame; });
+}
+
+std::vector<Benchmark::Event> Benchmark::events(unsigned frame) const {
+	auto first = std::lower_bound(script.begin(), script.end(), frame,
+		[](const Event& e, unsigned f) { return e.frame < f; });
+	std::vector<Event> result;
+	for (auto e = first; e != script.end() && e->frame == frame; ++e)
+		result.push_back(*e);
+	return result;
+}
+
+void Benchmark::describe(const std::string& key, const std::string& value) {
+	description.push_back({ key, value });
+}
+
+void Benchmark::endFrame(unsigned frame, double cpuMs, const GpuProfiler* profiler) {
+	if (frame >= warmupCount && frame < frameCount) {
+		frameMs.push_back(float(cpuMs));
+		measuredSeconds += cpuMs * 0.001;
+	}
+	if (!profiler) return;
+
+	// Frame the collected GPU times belong to
+	unsigned behind = unsigned(profiler->latency() - 1);
+	if (frame < warmupCount + behind || frame >= frameCount + behind) return;
+	gpuFrameMs.push_back(float(profiler->lastFrameMs()));
+	std::vector<std::string> names = profiler->zoneNames();
+	for (auto n = names.begin(); n != names.end(); ++n) {
+		auto p = std::find_if(passes.begin(), passes.end(), [&](const PassTimes& t) { return t.name == *n; });
+		if (p == passes.end()) {
+			// Not entered in the frames measured so far
+			passes.push_back({ *n, std::vector<float>(gpuFrameMs.size() - 1, 0.0f) });
+			p = passes.end() - 1;
+		}
+		p->ms.push_back(float(profiler->lastMs(*n)));
+	}
+}
+
+unsigned Benchmark::framesToRender(const GpuProfiler* profiler) const {
+	return profiler ? frameCount + unsigned(profiler->latency() - 1) : frameCount;
+}
+
+Benchmark::Stats Benchmark::stats(std::vector<float> samples) {
+	Stats s = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	if (samples.empty()) return s;
+
+	// Nearest rank, as in GpuProfiler::percentileMs()
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&](double p) { return samples[size_t(p / 100.0 * (samples.size() - 1) + 0.5)]; };
+	double sum = 0.0;
+	for (auto v = samples.begin(); v != samples.end(); ++v)
+		sum += *v;
+	s.minMs = samples.front();
+	s.averageMs = sum / samples.size();
+	s.p50Ms = percentile(50.0);
+	s.p95Ms = percentile(95.0);
+	s.p99Ms = percentile(99.0);
+	s.maxMs = samples.back();
+	return s;
+}
+
+void Benchmark::report(std::ostream& out, int simSteps) const {
+	size_t measured = frameMs.size();
+	out << "Benchmark " << path << ": " << measured << " frames measured after " << warmupCount << " warmup frames" << std::endl;
+	if (measured == 0) return;
+
+	auto row = [&](const std::string& name, const Stats& s) {
+		out << "  " << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(10) << s.minMs << std::setw(10) << s.averageMs << std::setw(10) << s.p50Ms
+			<< std::setw(10) << s.p95Ms << std::setw(10) << s.p99Ms << std::setw(10) << s.maxMs << std::endl;
+	};
+	out << "  " << std::left << std::setw(24) << "ms" << std::right << std::setw(10) << "min" << std::setw(10) << "average"
+		<< std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+	row("Frame (CPU)", stats(frameMs));
+	if (!gpuFrameMs.empty())
+		row("Frame (GPU)", stats(gpuFrameMs));
+	for (auto p = passes.begin(); p != passes.end(); ++p)
+		row("  " + p->name, stats(p->ms));
+	out.unsetf(std::ios::floatfield);
+	out << std::setprecision(6);
+
+	double fps = measuredSeconds > 0.0 ? measured / measuredSeconds : 0.0;
+	out << "  " << fps << " frames per second, " << fps * simSteps << " wave steps per second" << std::endl;
+}
+
+void Benchmark::writeJson(const std::string& path, int simSteps) const {
+	std::ofstream out(path);
+	if (!out)
+		throw std::runtime_error("Benchmark::writeJson() - Cannot open " + path);
+
+	auto stats = [&](const Stats& s) {
+		out << "{\"min\":" << s.minMs << ",\"average\":" << s.averageMs << ",\"p50\":" << s.p50Ms
+			<< ",\"p95\":" << s.p95Ms << ",\"p99\":" << s.p99Ms << ",\"max\":" << s.maxMs << "}";
+	};
+	double fps = measuredSeconds > 0.0 ? frameMs.size() / measuredSeconds : 0.0;
+
+	out << std::fixed << std::setprecision(4) << "{\n  \"scenario\": \"";
+	writeEscaped(out, this->path);
+	out << "\",\n  \"frames\": " << frameCount << ",\n  \"warmup\": " << warmupCount << ",\n  \"seed\": " << rngSeed
+		<< ",\n  \"simSteps\": " << simSteps;
+	for (auto d = description.begin(); d != description.end(); ++d) {
+		out << ",\n  \"";
+		writeEscaped(out, d->first);
+		out << "\": \"";
+		writeEscaped(out, d->second);
+		out << "\"";
+	}
+	out << ",\n  \"measuredFrames\": " << frameMs.size() << ",\n  \"framesPerSecond\": " << fps
+		<< ",\n  \"stepsPerSecond\": " << fps * simSteps << ",\n  \"frameMs\": ";
+	stats(Benchmark::stats(frameMs));
+	out << ",\n  \"gpuFrameMs\": ";
+	stats(Benchmark::stats(gpuFrameMs));
+	out << ",\n  \"passMs\": {";
+	for (auto p = passes.begin(); p != passes.end(); ++p) {
+		out << (p == passes.begin() ? "\n    \"" : ",\n    \"");
+		writeEscaped(out, p->name);
+		out << "\": ";
+		stats(Benchmark::stats(p->ms));
+	}
+	out << "\n  }\n}\n";
+}
@@ -0,0 +1,171 @@
+#include "cdlod_surface.hpp"
+#include "gl_state.hpp"
+#include <algorithm>
+
+// Whether a box reaches into a sphere
+static bool boxInSphere(glm::vec3 minBB, glm::vec3 maxBB, glm::vec3 center, float radius) {
+	glm::vec3 closest = glm::clamp(center, minBB, maxBB);
+	glm::vec3 d = closest - center;
+	return glm::dot(d, d) <= radius * radius;
+}
+
+CdlodSurface::CdlodSurface(glm::vec2 origin, float size, float heightRange, int levels, float finestRange, int material, bool procedural) :
+	origin(origin), size(size), levels(levels), heightRange(heightRange), procedural(procedural) {
+	for (int l = 0; l < levels; l++)
+		ranges.push_back(finestRange * float(1 << l));
+	trianglesDrawn = 0;
+	vbuf = 0;
+	ibuf = 0;
+
+	// Create vertex array object
+	glGenVertexArrays(1, &vao);
+	GLState::bindVertexArray(vao);
+
+	// Create instance buffer (filled by draw())
+	glGenBuffers(1, &instBuf);
+	glBindBuffer(GL_ARRAY_BUFFER, instBuf);
+	glEnableVertexAttribArray(3);
+	glVertexAttribDivisor(3, 1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (procedural) {
+		// Two triangles per quad, in the order of the index buffer below
+		icount = PATCH_QUADS * PATCH_QUADS * 6;
+		return;
+	}
+
+	// Vertex format (same attributes as the scene geometry)
+	struct vert {
+		glm::vec3 pos;		// Grid position in [0, 1]
+		glm::vec2 tc;
+		int material;
+	};
+
+	// Patch grid
+	const int n = PATCH_QUADS + 1;
+	std::vector<vert> verts;
+	for (int j = 0; j < n; j++)
+		for (int i = 0; i < n; i++) {
+			glm::vec2 p(float(i) / PATCH_QUADS, float(j) / PATCH_QUADS);
+			verts.push_back({ glm::vec3(p.x, 0.0f, p.y), p, material });
+		}
+
+	// Vertex indices for triangles, one quadrant after the other
+	std::vector<GLuint> ids;
+	const int half = PATCH_QUADS / 2;
+	for (int q = 0; q < 4; q++) {
+		int i0 = (q & 1) ? half : 0;
+		int j0 = (q & 2) ? half : 0;
+		for (int j = j0; j < j0 + half; j++)
+			for (int i = i0; i < i0 + half; i++) {
+				GLuint v = j * n + i;
+				ids.push_back(v);
+				ids.push_back(v + n);
+				ids.push_back(v + 1);
+
+				ids.push_back(v + 1);
+				ids.push_back(v + n);
+				ids.push_back(v + n + 1);
+			}
+	}
+	icount = GLsizei(ids.size());
+
+	// Create vertex buffer
+	glGenBuffers(1, &vbuf);
+	glBindBuffer(GL_ARRAY_BUFFER, vbuf);
+	glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(vert), verts.data(), GL_STATIC_DRAW);
+	// Specify vertex attributes
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vert), (GLvoid*)offsetof(vert, pos));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vert), (GLvoid*)offsetof(vert, tc));
+	glEnableVertexAttribArray(2);
+	glVertexAttribIPointer(2, 1, GL_INT, sizeof(vert), (GLvoid*)offsetof(vert, material));
+	// Create index buffer
+	glGenBuffers(1, &ibuf);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibuf);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+
+	// Cleanup state
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CdlodSurface::select(const glm::vec3& camPos, std::vector<Patch>& patches,
+	std::function<bool(glm::vec3, glm::vec3)> boxVisible) const {
+	patches.clear();
+	selectNode(origin, size, levels - 1, camPos, patches, boxVisible);
+}
+
+// Returns false if the node is out of its level's range (its parent covers the area)
+bool CdlodSurface::selectNode(glm::vec2 origin, float size, int level, const glm::vec3& camPos,
+	std::vector<Patch>& patches, const std::function<bool(glm::vec3, glm::vec3)>& boxVisible) const {
+	glm::vec3 minBB(origin.x, -heightRange, origin.y);
+	glm::vec3 maxBB(origin.x + size, heightRange, origin.y + size);
+
+	// The coarsest level covers everything
+	if (level < levels - 1 && !boxInSphere(minBB, maxBB, camPos, ranges[level]))
+		return false;
+	if (boxVisible && !boxVisible(minBB, maxBB))
+		return true;
+
+	// Whole node at this level if no part of it needs finer detail
+	if (level == 0 || !boxInSphere(minBB, maxBB, camPos, ranges[level - 1])) {
+		patches.push_back({ origin, size, ranges[level], -1 });
+		return true;
+	}
+
+	// Otherwise refine; quarters out of the finer range are drawn at this level
+	float half = size * 0.5f;
+	for (int q = 0; q < 4; q++) {
+		glm::vec2 childOrigin = origin + glm::vec2((q & 1) ? half : 0.0f, (q & 2) ? half : 0.0f);
+		if (!selectNode(childOrigin, half, level - 1, camPos, patches, boxVisible))
+			patches.push_back({ origin, size, ranges[level], q });
+	}
+	return true;
+}
+
+void CdlodSurface::draw(const std::vector<Patch>& patches) {
+	if (patches.empty()) return;
+
+	// Group the instances by the part of the grid they draw
+	sorted = patches;
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Patch& a, const Patch& b) { return a.quadrant < b.quadrant; });
+
+	GLState::bindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, instBuf);
+	glBufferData(GL_ARRAY_BUFFER, sorted.size() * sizeof(Patch), sorted.data(), GL_STREAM_DRAW);
+
+	for (size_t first = 0; first < sorted.size();) {
+		size_t last = first;
+		while (last < sorted.size() && sorted[last].quadrant == sorted[first].quadrant) last++;
+
+		int quadrant = sorted[first].quadrant;
+		GLsizei count = quadrant < 0 ? icount : icount / 4;
+		GLint start = quadrant < 0 ? 0 : quadrant * (icount / 4);
+		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Patch), (GLvoid*)(first * sizeof(Patch)));
+		if (procedural)
+			glDrawArraysInstanced(GL_TRIANGLES, start, count, GLsizei(last - first));
+		else glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT, (GLvoid*)(start * sizeof(GLuint)), GLsizei(last - first));
+		trianglesDrawn += size_t(count / 3) * (last - first);
+
+		first = last;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+size_t CdlodSurface::fullGridTriangles() const {
+	size_t quads = size_t(PATCH_QUADS) << (levels - 1);
+	return 2 * quads * quads;
+}
+
+// Release resources
+void CdlodSurface::release() {
+	if (vao) {
+		GLState::forgetVertexArray(vao);
+		glDeleteVertexArrays(1, &vao);
+		vao = 0;
+	}
+	if (vbuf) { glDeleteBuffers(1, &vbuf); vbuf = 0; }
+	if (ibuf) { glDeleteBuffers(1, &ibuf); ibuf = 0; }
+	if (instBuf) { glDeleteBuffers(1, &instBuf); instBuf = 0; }
+}
@@ -0,0 +1,88 @@
+#include "cpu_trace.hpp"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstring>
+
+std::atomic<bool> CpuTrace::active(false);
+
+namespace {
+	struct Event {
+		char name[CpuTrace::NAME_SIZE];
+		uint64_t begin;
+		uint64_t end;
+	};
+
+	// Zones of one thread; only that thread writes, count is published after each event
+	struct ThreadRing {
+		std::vector<Event> events;
+		std::atomic<uint64_t> count;
+		unsigned tid;
+	};
+
+	// Rings are kept until exit, so zones of finished threads can still be written
+	std::mutex ringsMutex;
+	std::vector<std::unique_ptr<ThreadRing>> rings;
+	thread_local ThreadRing* threadRing = nullptr;
+
+	const uint64_t origin = CpuTrace::now();
+
+	void writeEscaped(std::ostream& out, const char* s) {
+		for (; *s; s++) {
+			if (*s == '"' || *s == '\\') out << '\\';
+			if ((unsigned char)*s >= 0x20) out << *s;
+		}
+	}
+}
+
+uint64_t CpuTrace::now() {
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void CpuTrace::record(const char* name, uint64_t begin, uint64_t end) {
+	if (!threadRing) {
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		rings.push_back(std::make_unique<ThreadRing>());
+		threadRing = rings.back().get();
+		threadRing->events.resize(RING_SIZE);
+		threadRing->count.store(0);
+		threadRing->tid = unsigned(rings.size());
+	}
+
+	uint64_t n = threadRing->count.load(std::memory_order_relaxed);
+	Event& e = threadRing->events[n % RING_SIZE];
+	std::strncpy(e.name, name, NAME_SIZE - 1);
+	e.name[NAME_SIZE - 1] = '\0';
+	e.begin = begin;
+	e.end = end;
+	threadRing->count.store(n + 1, std::memory_order_release);
+}
+
+void CpuTrace::writeJson(const std::string& path) {
+	std::ofstream out(path);
+	if (!out)
+		throw std::runtime_error("CpuTrace::writeJson() - Cannot open " + path);
+
+	// Complete ("X") events with microsecond timestamps
+	out << "{\"traceEvents\":[" << std::fixed << std::setprecision(3);
+	bool first = true;
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	for (auto r = rings.begin(); r != rings.end(); ++r) {
+		uint64_t count = (*r)->count.load(std::memory_order_acquire);
+		uint64_t start = count > RING_SIZE ? count - RING_SIZE : 0;
+		for (uint64_t i = start; i < count; i++) {
+			const Event& e = (*r)->events[i % RING_SIZE];
+			out << (first ? "\n" : ",\n") << "{\"name\":\"";
+			writeEscaped(out, e.name);
+			out << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (*r)->tid
+				<< ",\"ts\":" << (e.begin - origin) * 1e-3 << ",\"dur\":" << (e.end - e.begin) * 1e-3 << "}";
+			first = false;
+		}
+	}
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
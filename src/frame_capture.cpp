@@ -0,0 +1,228 @@
+#include "frame_capture.hpp"
+#include "gl_state.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+namespace {
+	// Output callback of stb_image_write
+	void writeStream(void* context, void* data, int size) {
+		((std::ostream*)context)->write((const char*)data, size);
+	}
+}
+
+FrameCapture::FrameCapture(const std::string& prefix, Format format, int ringSize, size_t queueSize, int encoderCount) :
+	prefix(prefix), format(format), queueSize(queueSize), ringSize(size_t(ringSize)) {
+	frames = 0;
+	stopping = false;
+	written = 0;
+	failed = 0;
+	pushes = 0;
+	occupancySum = 0.0;
+	occupancyMax = 0;
+	waitSeconds = 0.0;
+
+	spare.resize(ringSize);
+	for (auto s = spare.begin(); s != spare.end(); ++s) {
+		glGenBuffers(1, &s->pbo);
+		s->fence = 0;
+		s->frame = 0;
+		s->width = 0;
+		s->height = 0;
+	}
+
+	if (encoderCount <= 0)
+		encoderCount = std::max(int(std::thread::hardware_concurrency()) - 1, 1);
+	for (int i = 0; i < encoderCount; i++)
+		encoders.push_back(std::thread(&FrameCapture::encode, this));
+}
+
+void FrameCapture::capture(GLuint framebuffer, GLsizei width, GLsizei height) {
+	if (frames == 0)
+		firstCapture = std::chrono::steady_clock::now();
+
+	// Queue the readbacks the GPU has finished, oldest first; the others stay for a later frame
+	while (!pending.empty() && finished(pending.front())) {
+		collect(pending.front());
+		spare.push_back(pending.front());
+		pending.pop_front();
+	}
+
+	// If the GPU is behind every buffer, the ring grows instead of waiting for it
+	Slot slot;
+	if (spare.empty()) {
+		glGenBuffers(1, &slot.pbo);
+		slot.width = 0;
+		slot.height = 0;
+	}
+	else {
+		slot = spare.back();
+		spare.pop_back();
+	}
+
+	GLsizeiptr size = GLsizeiptr(width) * height * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	if (slot.width != width || slot.height != height)
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+
+	GLState::bindFramebuffer(framebuffer);
+	glReadBuffer(framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frame = frames++;
+	slot.width = width;
+	slot.height = height;
+	pending.push_back(slot);
+	ringSize = std::max(ringSize, pending.size() + spare.size());
+}
+
+bool FrameCapture::finished(const Slot& slot) const {
+	GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status == GL_WAIT_FAILED)
+		throw std::runtime_error("FrameCapture::finished() - Cannot poll the readback fence");
+	return status != GL_TIMEOUT_EXPIRED;
+}
+
+void FrameCapture::collect(Slot& slot) {
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	Job job = { slot.frame, slot.width, slot.height, std::vector<unsigned char>(size_t(slot.width) * slot.height * 4) };
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(job.pixels.size()), GL_MAP_READ_BIT);
+	if (pixels) {
+		std::memcpy(job.pixels.data(), pixels, job.pixels.size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if (!pixels)
+		throw std::runtime_error("FrameCapture::collect() - Cannot map the pixel buffer");
+
+	push(std::move(job));
+}
+
+void FrameCapture::push(Job&& job) {
+	std::unique_lock<std::mutex> lock(queueMutex);
+	if (queue.size() >= queueSize) {
+		auto waitStart = std::chrono::steady_clock::now();
+		queueNotFull.wait(lock, [this]() { return queue.size() < queueSize; });
+		waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+	}
+	pushes++;
+	occupancySum += double(queue.size());
+	occupancyMax = std::max(occupancyMax, queue.size() + 1);
+	queue.push_back(std::move(job));
+	queueNotEmpty.notify_one();
+}
+
+void FrameCapture::encode() {
+	for (;;) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueNotEmpty.wait(lock, [this]() { return stopping || !queue.empty(); });
+			if (queue.empty()) return;
+			job = std::move(queue.front());
+			queue.pop_front();
+			queueNotFull.notify_one();
+		}
+
+		bool ok = write(job);
+
+		std::lock_guard<std::mutex> lock(queueMutex);
+		if (ok) written++;
+		else failed++;
+		lastWrite = std::chrono::steady_clock::now();
+	}
+}
+
+bool FrameCapture::write(const Job& job) const {
+	std::ostringstream path;
+	path << prefix << "_" << std::setw(6) << std::setfill('0') << job.frame << (format == FORMAT_PNG ? ".png" : ".ppm");
+	std::ofstream out(path.str(), std::ios::binary);
+	if (!out) return false;
+
+	// Top row first, without alpha
+	size_t stride = size_t(job.width) * 3;
+	std::vector<unsigned char> rows(stride * job.height);
+	for (GLsizei y = 0; y < job.height; y++) {
+		unsigned char* row = &rows[stride * y];
+		const unsigned char* src = &job.pixels[size_t(job.height - 1 - y) * job.width * 4];
+		for (GLsizei x = 0; x < job.width; x++, src += 4, row += 3) {
+			row[0] = src[0];
+			row[1] = src[1];
+			row[2] = src[2];
+		}
+	}
+
+	if (format == FORMAT_PNG) {
+		if (!stbi_write_png_to_func(writeStream, &out, job.width, job.height, 3, rows.data(), int(stride)))
+			return false;
+	}
+	else {
+		out << "P6\n" << job.width << " " << job.height << "\n255\n";
+		out.write((const char*)rows.data(), rows.size());
+	}
+	return bool(out);
+}
+
+void FrameCapture::finish() {
+	// Nothing is rendered anymore, so the last readbacks are waited for
+	while (!pending.empty()) {
+		glClientWaitSync(pending.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		collect(pending.front());
+		spare.push_back(pending.front());
+		pending.pop_front();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopping = true;
+	}
+	queueNotEmpty.notify_all();
+	for (auto t = encoders.begin(); t != encoders.end(); ++t)
+		t->join();
+	encoders.clear();
+}
+
+void FrameCapture::report(std::ostream& out) const {
+	double seconds = written + failed ? std::chrono::duration<double>(lastWrite - firstCapture).count() : 0.0;
+	out << "Frame capture: " << written << " of " << frames << " frames written";
+	if (failed)
+		out << " (" << failed << " could not be written to " << prefix << "_*)";
+	if (seconds > 0.0)
+		out << ", " << written / seconds << " frames per second sustained";
+	out << ", queue occupancy " << (pushes ? occupancySum / pushes : 0.0) << " on average, "
+		<< occupancyMax << " at most (of " << queueSize << "), " << ringSize << " pixel buffers, render thread waited "
+		<< waitSeconds << " s on the full queue" << std::endl;
+}
+
+// Release resources
+void FrameCapture::release() {
+	if (!encoders.empty()) {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		queueNotEmpty.notify_all();
+		for (auto t = encoders.begin(); t != encoders.end(); ++t)
+			t->join();
+		encoders.clear();
+	}
+	for (auto s = pending.begin(); s != pending.end(); ++s) {
+		glDeleteSync(s->fence);
+		glDeleteBuffers(1, &s->pbo);
+	}
+	for (auto s = spare.begin(); s != spare.end(); ++s)
+		glDeleteBuffers(1, &s->pbo);
+	pending.clear();
+	spare.clear();
+}
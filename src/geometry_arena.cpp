@@ -0,0 +1,88 @@
+#include "geometry_arena.hpp"
+#include "gl_state.hpp"
+#include <stdexcept>
+
+GeometryArena::GeometryArena(GLsizei vertexSize) : vertexSize(vertexSize) {
+	vertexCount = 0;
+	indexCount = 0;
+	vao = 0;
+	vbuf = 0;
+	ibuf = 0;
+}
+
+void GeometryArena::addAttribute(GLuint index, GLint size, GLenum type, GLsizei offset) {
+	attributes.push_back({ index, size, type, offset, false });
+}
+
+void GeometryArena::addIntAttribute(GLuint index, GLint size, GLenum type, GLsizei offset) {
+	attributes.push_back({ index, size, type, offset, true });
+}
+
+GeometryArena::Range GeometryArena::add(const void* vertices, GLsizei vertexCount, const std::vector<GLuint>& indices) {
+	if (vao)
+		throw std::runtime_error("GeometryArena::add() - Arena has already been uploaded");
+
+	Range range = { GLsizei(indices.size()), indexCount, GLint(this->vertexCount) };
+	const char* data = (const char*)vertices;
+	this->vertices.insert(this->vertices.end(), data, data + vertexCount * vertexSize);
+	this->indices.insert(this->indices.end(), indices.begin(), indices.end());
+	this->vertexCount += vertexCount;
+	indexCount += GLsizeiptr(indices.size());
+	return range;
+}
+
+void GeometryArena::upload() {
+	// Create vertex array object
+	glGenVertexArrays(1, &vao);
+	GLState::bindVertexArray(vao);
+
+	// Create vertex buffer
+	glGenBuffers(1, &vbuf);
+	glBindBuffer(GL_ARRAY_BUFFER, vbuf);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data(), GL_STATIC_DRAW);
+	// Specify vertex attributes
+	for (auto a = attributes.begin(); a != attributes.end(); ++a) {
+		glEnableVertexAttribArray(a->index);
+		if (a->integer)
+			glVertexAttribIPointer(a->index, a->size, a->type, vertexSize, (GLvoid*)(GLsizeiptr)a->offset);
+		else glVertexAttribPointer(a->index, a->size, a->type, GL_FALSE, vertexSize, (GLvoid*)(GLsizeiptr)a->offset);
+	}
+	// Create index buffer
+	glGenBuffers(1, &ibuf);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibuf);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+	// Cleanup state (the index buffer stays attached to the vertex array)
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// The GPU holds the only copy from now on
+	std::vector<char>().swap(vertices);
+	std::vector<GLuint>().swap(indices);
+}
+
+void GeometryArena::draw(const std::vector<Range>& ranges, GLenum mode) {
+	counts.clear();
+	offsets.clear();
+	baseVertices.clear();
+	for (auto r = ranges.begin(); r != ranges.end(); ++r) {
+		if (r->count == 0) continue;
+		counts.push_back(r->count);
+		offsets.push_back((const GLvoid*)(r->firstIndex * sizeof(GLuint)));
+		baseVertices.push_back(r->baseVertex);
+	}
+	if (counts.empty()) return;
+
+	GLState::bindVertexArray(vao);
+	glMultiDrawElementsBaseVertex(mode, counts.data(), GL_UNSIGNED_INT, offsets.data(), GLsizei(counts.size()), baseVertices.data());
+}
+
+// Release resources
+void GeometryArena::release() {
+	if (vao) {
+		GLState::forgetVertexArray(vao);
+		glDeleteVertexArrays(1, &vao);
+		vao = 0;
+	}
+	if (vbuf) { glDeleteBuffers(1, &vbuf); vbuf = 0; }
+	if (ibuf) { glDeleteBuffers(1, &ibuf); ibuf = 0; }
+}
@@ -0,0 +1,134 @@
+#include "gl_state.hpp"
+
+GLuint GLState::program = GLState::UNKNOWN;
+GLuint GLState::vao = GLState::UNKNOWN;
+GLuint GLState::fbo = GLState::UNKNOWN;
+GLuint GLState::activeUnit = GLState::UNKNOWN;
+GLuint GLState::textures2D[GLState::MAX_UNITS];
+GLuint GLState::texturesCube[GLState::MAX_UNITS];
+GLsizei GLState::viewportW = -1;
+GLsizei GLState::viewportH = -1;
+std::map<GLenum, bool> GLState::caps;
+
+GLState::Counters GLState::current = { 0, 0 };
+GLState::Counters GLState::last = { 0, 0 };
+GLState::Counters GLState::total = { 0, 0 };
+
+void GLState::useProgram(GLuint program) {
+	if (GLState::program == program) { current.elided++; return; }
+	glUseProgram(program);
+	GLState::program = program;
+	current.issued++;
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+	if (GLState::vao == vao) { current.elided++; return; }
+	glBindVertexArray(vao);
+	GLState::vao = vao;
+	current.issued++;
+}
+
+void GLState::bindFramebuffer(GLuint fbo) {
+	if (GLState::fbo == fbo) { current.elided++; return; }
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::fbo = fbo;
+	current.issued++;
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+	GLuint* slot = nullptr;
+	if (unit < MAX_UNITS) {
+		if (target == GL_TEXTURE_2D) slot = &textures2D[unit];
+		else if (target == GL_TEXTURE_CUBE_MAP) slot = &texturesCube[unit];
+	}
+	if (slot && *slot == texture) { current.elided++; return; }
+
+	if (activeUnit != unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeUnit = unit;
+		current.issued++;
+	}
+	glBindTexture(target, texture);
+	if (slot) *slot = texture;
+	current.issued++;
+}
+
+void GLState::viewport(GLsizei width, GLsizei height) {
+	if (viewportW == width && viewportH == height) { current.elided++; return; }
+	glViewport(0, 0, width, height);
+	viewportW = width;
+	viewportH = height;
+	current.issued++;
+}
+
+void GLState::enable(GLenum cap) {
+	auto it = caps.find(cap);
+	if (it != caps.end() && it->second) { current.elided++; return; }
+	glEnable(cap);
+	caps[cap] = true;
+	current.issued++;
+}
+
+void GLState::disable(GLenum cap) {
+	auto it = caps.find(cap);
+	if (it != caps.end() && !it->second) { current.elided++; return; }
+	glDisable(cap);
+	caps[cap] = false;
+	current.issued++;
+}
+
+bool GLState::isEnabled(GLenum cap) {
+	auto it = caps.find(cap);
+	if (it != caps.end()) return it->second;
+	bool enabled = glIsEnabled(cap) == GL_TRUE;
+	caps[cap] = enabled;
+	return enabled;
+}
+
+void GLState::invalidate() {
+	program = UNKNOWN;
+	vao = UNKNOWN;
+	fbo = UNKNOWN;
+	activeUnit = UNKNOWN;
+	for (int i = 0; i < MAX_UNITS; i++) {
+		textures2D[i] = UNKNOWN;
+		texturesCube[i] = UNKNOWN;
+	}
+	viewportW = -1;
+	viewportH = -1;
+	caps.clear();
+}
+
+void GLState::forgetProgram(GLuint program) {
+	if (GLState::program == program) GLState::program = UNKNOWN;
+}
+
+void GLState::forgetVertexArray(GLuint vao) {
+	if (GLState::vao == vao) GLState::vao = UNKNOWN;
+}
+
+void GLState::forgetFramebuffer(GLuint fbo) {
+	if (GLState::fbo == fbo) GLState::fbo = UNKNOWN;
+}
+
+void GLState::forgetTexture(GLuint texture) {
+	for (int i = 0; i < MAX_UNITS; i++) {
+		if (textures2D[i] == texture) textures2D[i] = UNKNOWN;
+		if (texturesCube[i] == texture) texturesCube[i] = UNKNOWN;
+	}
+}
+
+void GLState::endFrame() {
+	last = current;
+	total.issued += current.issued;
+	total.elided += current.elided;
+	current = { 0, 0 };
+}
+
+GLState::Counters GLState::frameCounters() {
+	return last;
+}
+
+GLState::Counters GLState::totalCounters() {
+	return total;
+}
@@ -0,0 +1,77 @@
+#include "window.hpp"
+#include <stdexcept>
+
+#ifdef USE_GLUT
+#include <GL/freeglut.h>
+
+// Window and main loop of freeglut (only one window per process)
+class GlutWindow : public Window {
+public:
+	GlutWindow(int* argc, char** argv, int width, int height, const std::string& title) {
+		glutInit(argc, argv);
+		glutInitWindowSize(width, height);
+		glutInitContextVersion(3, 3);
+		glutInitContextProfile(GLUT_CORE_PROFILE);
+		glutInitDisplayMode(GLUT_RGBA | GLUT_DEPTH | GLUT_DOUBLE);
+		// Create the window
+		glutCreateWindow(title.c_str());
+	}
+
+	void run(const Callbacks& callbacks) override {
+		// GLUT callbacks
+		glutDisplayFunc(callbacks.display);
+		glutReshapeFunc(callbacks.reshape);
+		glutKeyboardUpFunc(callbacks.keyRelease);
+		glutMouseFunc(callbacks.mouseButton);
+		glutMotionFunc(callbacks.mouseMove);
+		glutIdleFunc(callbacks.idle);
+		glutCloseFunc(callbacks.close);
+
+		glutMainLoop();
+	}
+
+	void requestExit() override { glutLeaveMainLoop(); }
+	void postRedisplay() override { glutPostRedisplay(); }
+
+	void swapBuffers() override {
+		glutSwapBuffers();
+		frames++;
+	}
+
+	void setMenu(const std::vector<MenuEntry>& entries, void (*handler)(int)) override {
+		createMenu(entries, handler);
+		glutAttachMenu(GLUT_RIGHT_BUTTON);
+	}
+
+	void setTitle(const std::string& title) override { glutSetWindowTitle(title.c_str()); }
+
+	double elapsedSeconds() const override { return glutGet(GLUT_ELAPSED_TIME) * 0.001; }
+
+protected:
+	// Submenus are created first, the menu created last is the current one
+	static int createMenu(const std::vector<MenuEntry>& entries, void (*handler)(int)) {
+		std::vector<int> submenus;
+		for (auto e = entries.begin(); e != entries.end(); ++e)
+			submenus.push_back(e->submenu.empty() ? 0 : createMenu(e->submenu, handler));
+
+		int menu = glutCreateMenu(handler);
+		for (size_t i = 0; i < entries.size(); i++) {
+			if (submenus[i])
+				glutAddSubMenu(entries[i].label.c_str(), submenus[i]);
+			else glutAddMenuEntry(entries[i].label.c_str(), entries[i].command);
+		}
+		return menu;
+	}
+};
+
+std::unique_ptr<Window> Window::createGlut(int* argc, char** argv, int width, int height, const std::string& title) {
+	return std::make_unique<GlutWindow>(argc, argv, width, height, title);
+}
+
+#else
+
+std::unique_ptr<Window> Window::createGlut(int* /*argc*/, char** /*argv*/, int /*width*/, int /*height*/, const std::string& /*title*/) {
+	throw std::runtime_error("Window::createGlut() - Built without the GLUT backend (USE_GLUT)");
+}
+
+#endif
@@ -0,0 +1,148 @@
+#include "gpu_profiler.hpp"
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+
+GpuProfiler::GpuProfiler(int framesInFlight) : framesInFlight(framesInFlight) {
+	slot = 0;
+	framesCollected = 0;
+	lastFrameTotal = 0.0;
+	active = nullptr;
+}
+
+GpuProfiler::Zone* GpuProfiler::find(const std::string& name) {
+	for (auto z = zones.begin(); z != zones.end(); ++z)
+		if (z->name == name) return &*z;
+	return nullptr;
+}
+
+const GpuProfiler::Zone* GpuProfiler::find(const std::string& name) const {
+	for (auto z = zones.begin(); z != zones.end(); ++z)
+		if (z->name == name) return &*z;
+	return nullptr;
+}
+
+void GpuProfiler::begin(const std::string& name) {
+	if (active)
+		throw std::runtime_error("GpuProfiler::begin() - " + name + " started inside " + active->name);
+
+	Zone* zone = find(name);
+	if (!zone) {
+		zones.push_back({ name, std::vector<std::vector<GLuint>>(framesInFlight), std::vector<int>(framesInFlight, 0), 0.0, 0.0, 0, {} });
+		zone = &zones.back();
+	}
+
+	// More entries than ever before in a frame need another query
+	std::vector<GLuint>& queries = zone->queries[slot];
+	if (zone->used[slot] == int(queries.size())) {
+		GLuint query;
+		glGenQueries(1, &query);
+		queries.push_back(query);
+	}
+	glBeginQuery(GL_TIME_ELAPSED, queries[zone->used[slot]++]);
+	active = zone;
+}
+
+void GpuProfiler::end() {
+	if (!active)
+		throw std::runtime_error("GpuProfiler::end() - No zone started");
+	glEndQuery(GL_TIME_ELAPSED);
+	active = nullptr;
+}
+
+void GpuProfiler::endFrame() {
+	slot = (slot + 1) % framesInFlight;
+
+	// Read back the queries of framesInFlight frames ago before they are reused.
+	// The first frame (shader compilation, uploads) is not representative and skipped.
+	bool collected = false;
+	double frameMs = 0.0;
+	for (auto z = zones.begin(); z != zones.end(); ++z) {
+		if (z->used[slot] == 0) {
+			z->lastMs = 0.0;
+			continue;
+		}
+		GLuint64 elapsed = 0;
+		for (int i = 0; i < z->used[slot]; i++) {
+			GLuint64 ns;
+			glGetQueryObjectui64v(z->queries[slot][i], GL_QUERY_RESULT, &ns);
+			elapsed += ns;
+		}
+		z->used[slot] = 0;
+		collected = true;
+		if (framesCollected == 0) continue;
+		z->lastMs = elapsed * 1e-6;
+		z->totalMs += z->lastMs;
+		if (z->history.size() < HISTORY)
+			z->history.push_back(float(z->lastMs));
+		else z->history[z->samples % HISTORY] = float(z->lastMs);
+		z->samples++;
+		frameMs += z->lastMs;
+		if (csv.is_open())
+			csv << framesCollected << ',' << z->name << ',' << z->lastMs << '\n';
+	}
+	if (collected) {
+		if (framesCollected > 0) lastFrameTotal = frameMs;
+		framesCollected++;
+	}
+}
+
+std::vector<std::string> GpuProfiler::zoneNames() const {
+	std::vector<std::string> names;
+	for (auto z = zones.begin(); z != zones.end(); ++z)
+		names.push_back(z->name);
+	return names;
+}
+
+double GpuProfiler::averageMs(const std::string& name) const {
+	const Zone* zone = find(name);
+	return zone && zone->samples ? zone->totalMs / zone->samples : 0.0;
+}
+
+double GpuProfiler::lastMs(const std::string& name) const {
+	const Zone* zone = find(name);
+	return zone ? zone->lastMs : 0.0;
+}
+
+double GpuProfiler::percentileMs(const std::string& name, double percentile) const {
+	const Zone* zone = find(name);
+	if (!zone || zone->history.empty()) return 0.0;
+
+	std::vector<float> sorted = zone->history;
+	size_t rank = size_t(percentile / 100.0 * (sorted.size() - 1) + 0.5);
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+	return sorted[rank];
+}
+
+void GpuProfiler::logCsv(const std::string& path) {
+	csv.open(path);
+	if (!csv)
+		throw std::runtime_error("GpuProfiler::logCsv() - Cannot open " + path);
+	csv << "frame,zone,ms\n";
+}
+
+void GpuProfiler::report(std::ostream& out) const {
+	double total = 0.0;
+	out << "  " << std::left << std::setw(24) << "" << std::right << std::setw(12) << "average"
+		<< std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::endl;
+	for (auto z = zones.begin(); z != zones.end(); ++z) {
+		double ms = z->samples ? z->totalMs / z->samples : 0.0;
+		out << "  " << std::left << std::setw(24) << z->name << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(9) << ms << " ms" << std::setw(10) << percentileMs(z->name, 50.0)
+			<< std::setw(10) << percentileMs(z->name, 95.0) << std::setw(10) << percentileMs(z->name, 99.0) << std::endl;
+		total += ms;
+	}
+	out << "  " << std::left << std::setw(24) << "Total" << std::right << std::setw(9) << total << " ms" << std::endl;
+	out.unsetf(std::ios::floatfield);
+	out << std::setprecision(6);
+}
+
+// Release resources
+void GpuProfiler::release() {
+	for (auto z = zones.begin(); z != zones.end(); ++z)
+		for (auto q = z->queries.begin(); q != z->queries.end(); ++q)
+			if (!q->empty()) glDeleteQueries(GLsizei(q->size()), q->data());
+	zones.clear();
+	active = nullptr;
+	if (csv.is_open()) csv.close();
+}
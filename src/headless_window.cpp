@@ -0,0 +1,156 @@
+#include "window.hpp"
+#include "gl_state.hpp"
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef USE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// Offscreen OpenGL context on EGL, drawing into a framebuffer object
+// The surfaceless Mesa platform is used when available, so no display
+// server is needed; without EGL_KHR_surfaceless_context a small pbuffer
+// keeps the context current.
+class HeadlessWindow : public Window {
+public:
+	HeadlessWindow(int width, int height, unsigned frameLimit) :
+		width(width), height(height), frameLimit(frameLimit), exitRequested(false) {
+		display = EGL_NO_DISPLAY;
+		surface = EGL_NO_SURFACE;
+		context = EGL_NO_CONTEXT;
+		fbo = 0;
+		colorBuffer = 0;
+		depthBuffer = 0;
+		start = std::chrono::steady_clock::now();
+
+		// Display without a window system if the client extensions allow it
+		const char* clientExts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (clientExts && std::strstr(clientExts, "EGL_MESA_platform_surfaceless") && getPlatformDisplay)
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display == EGL_NO_DISPLAY)
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+			throw std::runtime_error("HeadlessWindow::HeadlessWindow() - Cannot initialize EGL");
+		if (!eglBindAPI(EGL_OPENGL_API))
+			throw std::runtime_error("HeadlessWindow::HeadlessWindow() - EGL has no desktop OpenGL");
+
+		EGLint configAttribs[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+			EGL_NONE
+		};
+		EGLConfig config;
+		EGLint configCount = 0;
+		if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0)
+			throw std::runtime_error("HeadlessWindow::HeadlessWindow() - No EGL config for OpenGL");
+
+		EGLint contextAttribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 3,
+			EGL_CONTEXT_MINOR_VERSION, 3,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+		if (context == EGL_NO_CONTEXT)
+			throw std::runtime_error("HeadlessWindow::HeadlessWindow() - Cannot create an OpenGL 3.3 core context");
+
+		const char* displayExts = eglQueryString(display, EGL_EXTENSIONS);
+		if (!displayExts || !std::strstr(displayExts, "EGL_KHR_surfaceless_context")) {
+			EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+			surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+		}
+		if (!eglMakeCurrent(display, surface, surface, context))
+			throw std::runtime_error("HeadlessWindow::HeadlessWindow() - Cannot make the context current");
+
+		// Render target at the requested resolution
+		glGenRenderbuffers(1, &colorBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glGenRenderbuffers(1, &depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			throw std::runtime_error("HeadlessWindow::HeadlessWindow() - Offscreen framebuffer is incomplete");
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	~HeadlessWindow() { release(); }
+
+	void run(const Callbacks& callbacks) override {
+		if (callbacks.reshape) callbacks.reshape(width, height);
+
+		// Frames back to back; idle() is left out, it only paces the GLUT loop
+		auto loopStart = std::chrono::steady_clock::now();
+		while (!exitRequested && (frameLimit == 0 || frames < frameLimit))
+			callbacks.display();
+		glFinish();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count();
+
+		std::cout << "Headless: " << frames << " frames at " << width << "x" << height << " in " << seconds << " s ("
+			<< (seconds > 0.0 ? frames / seconds : 0.0) << " frames per second)" << std::endl;
+		if (callbacks.close) callbacks.close();
+	}
+
+	void requestExit() override { exitRequested = true; }
+
+	// Nothing is presented, the frame stays in the framebuffer object
+	void swapBuffers() override { frames++; }
+
+	double elapsedSeconds() const override {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	GLuint framebuffer() const override { return fbo; }
+
+	// Release resources
+	void release() {
+		if (context == EGL_NO_CONTEXT) return;
+		if (fbo) { GLState::forgetFramebuffer(fbo); glDeleteFramebuffers(1, &fbo); fbo = 0; }
+		if (colorBuffer) { glDeleteRenderbuffers(1, &colorBuffer); colorBuffer = 0; }
+		if (depthBuffer) { glDeleteRenderbuffers(1, &depthBuffer); depthBuffer = 0; }
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (surface != EGL_NO_SURFACE) { eglDestroySurface(display, surface); surface = EGL_NO_SURFACE; }
+		eglDestroyContext(display, context);
+		context = EGL_NO_CONTEXT;
+		eglTerminate(display);
+	}
+
+protected:
+	int width;
+	int height;
+	unsigned frameLimit;	// 0 for no limit
+	bool exitRequested;
+	std::chrono::steady_clock::time_point start;
+
+	// EGL objects
+	EGLDisplay display;
+	EGLSurface surface;		// Only without surfaceless contexts
+	EGLContext context;
+
+	// OpenGL resources
+	GLuint fbo;
+	GLuint colorBuffer;
+	GLuint depthBuffer;
+};
+
+std::unique_ptr<Window> Window::createHeadless(int width, int height, unsigned frameLimit) {
+	return std::make_unique<HeadlessWindow>(width, height, frameLimit);
+}
+
+#else
+
+std::unique_ptr<Window> Window::createHeadless(int /*width*/, int /*height*/, unsigned /*frameLimit*/) {
+	throw std::runtime_error("Window::createHeadless() - Built without the headless backend (USE_EGL)");
+}
+
+#endif
@@ -0,0 +1,118 @@
+#include "input_journal.hpp"
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+	// Name and argument count of every event type, in EventType order
+	const struct { const char* name; int args; } eventFormats[] = {
+		{ "reshape", 2 }, { "key", 3 }, { "button", 4 }, { "move", 2 }, { "menu", 1 }
+	};
+	const int eventTypeCount = int(sizeof(eventFormats) / sizeof(eventFormats[0]));
+}
+
+InputJournal::InputJournal(const std::string& path, Mode mode, unsigned seed) :
+	path(path), mode(mode), rngSeed(seed) {
+	next = 0;
+	endStep = UINT64_MAX;
+	lastStep = 0;
+	events = 0;
+
+	if (mode == MODE_RECORD) {
+		out.open(path);
+		if (!out)
+			throw std::runtime_error("InputJournal::InputJournal() - Cannot create " + path);
+		out << "seed " << rngSeed << "\n";
+		return;
+	}
+
+	std::ifstream in(path);
+	if (!in)
+		throw std::runtime_error("InputJournal::InputJournal() - Cannot open " + path);
+	bool hasSeed = false, hasEnd = false;
+	std::string line;
+	for (int lineNumber = 1; std::getline(in, line); lineNumber++) {
+		std::istringstream words(line);
+		std::string first;
+		if (!(words >> first)) continue;
+		auto fail = [&]() {
+			return std::runtime_error("InputJournal::InputJournal() - " + path + ":" + std::to_string(lineNumber) + ": cannot parse " + line);
+		};
+
+		if (first == "seed") {
+			if (!(words >> rngSeed)) throw fail();
+			hasSeed = true;
+			continue;
+		}
+
+		std::string name;
+		Entry e = { 0, { EVENT_RESHAPE, { 0, 0, 0, 0 } } };
+		std::istringstream stepWord(first);
+		if (!(stepWord >> e.step) || !(words >> name)) throw fail();
+		if (name == "end") {
+			endStep = e.step;
+			hasEnd = true;
+			continue;
+		}
+		int type = 0;
+		while (type < eventTypeCount && name != eventFormats[type].name) type++;
+		if (type == eventTypeCount) throw fail();
+		e.event.type = EventType(type);
+		for (int i = 0; i < eventFormats[type].args; i++)
+			if (!(words >> e.event.args[i])) throw fail();
+		if (!entries.empty() && e.step < entries.back().step) throw fail();
+		entries.push_back(e);
+	}
+	if (!hasSeed)
+		throw std::runtime_error("InputJournal::InputJournal() - " + path + " has no seed");
+	// A recording cut short ends after its last event
+	if (!hasEnd)
+		endStep = entries.empty() ? 0 : entries.back().step + 1;
+}
+
+void InputJournal::record(uint64_t step, const Event& event) {
+	if (!out.is_open()) return;
+	out << step << " " << eventFormats[event.type].name;
+	for (int i = 0; i < eventFormats[event.type].args; i++)
+		out << " " << event.args[i];
+	out << "\n";
+	lastStep = step;
+	events++;
+}
+
+std::vector<InputJournal::Event> InputJournal::due(uint64_t step) {
+	std::vector<Event> result;
+	for (; next < entries.size() && entries[next].step <= step; next++)
+		result.push_back(entries[next].event);
+	lastStep = step;
+	events += unsigned(result.size());
+	return result;
+}
+
+bool InputJournal::initialSize(int& width, int& height) const {
+	for (auto e = entries.begin(); e != entries.end(); ++e) {
+		if (e->event.type == EVENT_RESHAPE) {
+			width = e->event.args[0];
+			height = e->event.args[1];
+			return true;
+		}
+	}
+	return false;
+}
+
+void InputJournal::finish(uint64_t step) {
+	if (!out.is_open()) return;
+	out << step << " end\n";
+	lastStep = step;
+	out.close();
+}
+
+void InputJournal::report(std::ostream& out) const {
+	out << "Input journal: " << events << (mode == MODE_RECORD ? " events recorded to " : " events replayed from ")
+		<< path << " over " << lastStep << " simulation steps (seed " << rngSeed << ")" << std::endl;
+}
+
+// Release resources
+void InputJournal::release() {
+	if (out.is_open()) out.close();
+	entries.clear();
+}
@@ -1,14 +1,36 @@
 #include <iostream>
 #include <cassert>
 #include <memory>
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <array>
+#include <limits>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/type_precision.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "gl_core_3_3.h"
-#include <GL/freeglut.h>
+#include "window.hpp"
 #include "util.hpp"
 #include "mesh.hpp"
+#include "render_graph.hpp"
+#include "gl_state.hpp"
+#include "uniform_ring.hpp"
+#include "geometry_arena.hpp"
+#include "cdlod_surface.hpp"
+#include "gpu_profiler.hpp"
+#include "cpu_trace.hpp"
+#include "resolution_controller.hpp"
+#include "frame_capture.hpp"
+#include "benchmark.hpp"
+#include "input_journal.hpp"
+#include "obj_loader.hpp"
 #include "stb_image.h"
 
 #include "PerlinNoise.hpp"
@@ -20,46 +42,100 @@ struct vert {
 	int material;		// Material identifier
 };
 
+// Per-frame and per-view shader data (std140 layout of the FrameData uniform block in glsl/frame_data.glsl)
+struct FrameData {
+	glm::mat4 xform;			// Transformation matrix of the view
+	glm::mat4 lightViewXform;	// Light space transformation matrix
+	glm::vec3 lightDir;
+	float time;					// Seconds since startup
+	glm::vec3 camPos;			// World space camera position
+	float pad;
+	glm::vec4 clipPlane;		// Clip plane of the view (zero to disable)
+};
+
+// Views sharing the per-frame data
+enum { VIEW_CAMERA, VIEW_REFLECTION, VIEW_COUNT };
+
+// Display shader program and the uniforms set while drawing
+struct DispProgram {
+	GLuint program;
+	GLint uniModel;
+	GLint uniVertexSource;
+};
+
+// Static scene mesh drawn with the display shader
+struct SceneDraw {
+	int material;					// Material the fragments are shaded with
+	GeometryArena::Range range;
+};
+
+// Sources of vertex positions (vertexSource uniform of the display and caustics shaders)
+enum { VERTEX_ATTRIBUTES, VERTEX_PATCH, VERTEX_WATER_BODY };
+
 // Global state
 GLint width, height;				// Window size
+std::unique_ptr<Window> window;		// GLUT window or headless context
+bool headless;						// Render offscreen with the headless backend
+GLint headlessWidth, headlessHeight;	// Resolution of the headless framebuffer
+unsigned frameLimit;				// Frames rendered by the headless backend before it exits
 int texWidth, texHeight;			// Texture size (Both water and terrrain buffer textures)
+int normalTexWidth, normalTexHeight;	// Water gradient texture size (may be reduced)
+int simSteps;						// Wave equation steps per rendered frame
+uint64_t simStep;					// Wave equation steps run since startup
 
-std::vector<glm::u8vec3> initTexData;		// Texture data
+std::vector<float> initTexData;			// Texture data
 std::vector<glm::u8vec3> islandsTexData;		// Terrain height buffer texture
 unsigned char* wallTexData;
 unsigned char* terrTexData;				// Terrain shading texture
-std::vector<glm::u8vec3> refractionTexData;
-std::vector<glm::u8vec3> reflectionTexData;
-std::vector<glm::u8vec4> envMapData;
-std::vector<glm::u8vec4> causticsMapData;
 
 GLuint prevTexture;		// Texture objects
 GLuint currTexture;
 GLuint islandsTexture;
 GLuint wallTexture;
 GLuint terrTexture;
-GLuint refractionTexture;
-GLuint reflectionTexture;
 GLuint skyboxTexture;
-GLuint environmentMap;
-GLuint causticsMap;
+GLuint environmentMap;	// Light-space scene positions, cached across frames
+GLuint causticsMap;		// Blurred caustics, kept across frames for amortized updates
 
 GLuint gpgpuShader;		// Shader programs
-GLuint dispShader;
+GLuint normalShader;
+GLuint blurShader;
+DispProgram dispShader;		// Uber-shader shading every material
+std::vector<DispProgram> dispMaterialShaders;	// Specialized display shader per material (none if uberShader)
+bool dispGeometryShader;	// Display shader with the geometry shader stage (flat normals and clipping)
+bool uberShader;			// Shade all materials with dispShader
+bool benchmarkDisp;			// Time both display shader variants on the first frame
+bool benchmarkCaustics;		// Time the caustics pass for several photon grid sizes on the first frame
+std::string benchmarkObj;	// OBJ file to time both loaders on before exiting (empty for none)
+bool timePasses;			// Profile the GPU time of the render passes
+std::string profileCsv;		// File logging the GPU time of every pass and frame (empty for none)
+bool profileOverlay;		// Show the GPU time per pass on screen and in the window title
+std::string capturePrefix;	// Every frame is saved as <prefix>_<frame>.<png|ppm> (empty for none)
+FrameCapture::Format captureFormat;
+std::string traceFile;		// Chrome trace JSON of the CPU zones (written at exit and on T; empty for none)
+double frameBudget;			// GPU frame time held by dynamic resolution, in ms (0 for fixed resolution)
+std::unique_ptr<Benchmark> benchmark;	// Scripted run with frame time statistics (--benchmark)
+std::string benchmarkJson;	// JSON summary of the benchmark run (empty for none)
+uint64_t benchmarkFrameEnd;	// CpuTrace::now() at the end of the previous benchmark frame
+std::unique_ptr<InputJournal> journal;	// Input recording or replay (--record, --replay)
 GLuint envShader;
 GLuint causticsShader;
 GLuint debugShader;
-GLuint fbo;				// Framebuffer object
+std::unique_ptr<RenderGraph> renderGraph;	// Render passes and their targets
+
+std::unique_ptr<UniformRing> frameUniforms;	// FrameData blocks of the last few frames
+std::string frameDataSource;	// FrameData block declaration, prepended to the shaders reading it
 
-GLuint uniXform;		// Uniform shader parameters
-GLuint uniClipPlane;
+std::unique_ptr<GpuProfiler> gpuProfiler;	// GPU time per render pass (profiling options or --frame-budget)
+std::unique_ptr<FrameCapture> frameCapture;	// Readback and encoding of the saved frames (--capture)
+std::unique_ptr<ResolutionController> resolution;	// Refraction and reflection target scale (--frame-budget)
+
+GLuint uniEnvModel;		// Uniform shader parameters
 GLuint uniMousePos;
-GLuint uniCamPos;
-GLuint uniEnvXform;
-GLuint uniCausticsXform;
-GLuint uniLightDir;
-GLuint uniLightViewXform;
-GLuint uniLightDirDisp;
+GLuint uniBlurDirection;
+GLuint uniBlurScale;
+GLuint uniBlurWeight;
+GLuint uniPhotonGrid;
 
 glm::vec2 mousePos;
 
@@ -72,54 +148,72 @@ GLuint vbuf;			// Vertex buffer
 GLuint ibuf;			// Index buffer
 GLsizei vcount;			// Number of vertices
 
+std::unique_ptr<GeometryArena> sceneGeometry;	// Sky, walls, terrain and water
+
 GLuint waterVtsX, waterVtsY;
-GLuint waterVao;
-GLuint waterVbuf;
-GLuint waterIbuf;
-GLuint waterSurfVao;
-GLuint waterSurfVbuf;
-GLuint waterSurfIbuf;
-GLsizei waterVcount;
-GLsizei waterSurfVcount;
-std::vector<vert> waterVerts;
-std::vector<vert> waterSurfVerts;
-std::vector<GLuint> waterIds;
-std::vector<GLuint> waterSurfIds;
-
-GLuint wallVao;
-GLuint wallVbuf;
-GLuint wallIbuf;
-GLsizei wallVcount;
-std::vector<vert> wallVerts;
-std::vector<GLuint> wallIds;
-
-GLuint skyVao;
-GLuint skyVbuf;
-GLuint skyIbuf;
-GLsizei skyVcount;
-std::vector<vert> skyVerts;
-std::vector<GLuint> skyIds;
+bool proceduralWater;			// Generate the water grids from gl_VertexID instead of vertex buffers
+GLuint emptyVao;				// Vertex array without attributes (for procedural geometry)
+GeometryArena::Range waterRange;		// Water body (bottom and sides) if not procedural
+GLsizei waterBodyVcount;				// Vertices of the procedural water body
+int causticsGrid;						// Quads along each side of the caustics photon grid
+std::unique_ptr<CdlodSurface> waterSurface;		// Water surface
+
+GeometryArena::Range wallRange;
+
+GeometryArena::Range skyRange;
 
 GLuint terrVtsX, terrVtsY;
-GLuint terrVao;
-GLuint terrVbuf;
-GLuint terrIbuf;
-GLsizei terrVcount;
-std::vector<vert> terrVerts;
-std::vector<GLuint> terrIds;
+GeometryArena::Range terrRange;
 
 bool enableTerrain;
 
 // CAUSTICS VARIABLES
 glm::vec3 lightPos;
 
+unsigned renderedFrames;		// Frames display() rendered, for the per-frame statistics
+size_t benchmarkTriangles;		// Water surface triangles drawn by benchmarkDispShaders()
+
+// Environment map cache (re-rendered only when one of its inputs changes)
+bool envMapDirty;				// Set when the terrain changes
+glm::mat4 envMapXform;			// Light transformation it was rendered with
+glm::vec3 envMapMeshOffset;		// Mesh placement it was rendered with
+unsigned envMapRenders;			// Frames that re-rendered the map
+unsigned envMapReuses;			// Frames that reused the cached map
+
+// Amortized caustics (the map is re-rendered every causticsInterval frames)
+int causticsInterval;			// Frames between caustics map updates (1 for every frame)
+int causticsAge;				// Frames since the last update (-1 before the first one)
+unsigned causticsUpdates;		// Frames that re-rendered the caustics map
+unsigned causticsReuses;		// Frames that reused the previous map
+const float CAUSTICS_HISTORY = 0.5f;	// Share of the previous map kept by an amortized update
+// Photons overwrite the map without blending (benchmarkCausticsGrids() times the same state)
+const RenderGraph::PassState CAUSTICS_PASS_STATE = { GL_COLOR_BUFFER_BIT, false };
+
+glm::vec3 meshOffset;			// Placement of the mesh in the pool
+
 std::unique_ptr<Mesh> mesh;				// Mesh loaded from .obj file
+bool meshCache;							// Load the mesh from its binary cache (written on first load)
+
+// Mesh level of detail, picked per pass from the projected size of the mesh
+enum { MESH_PASS_ENVIRONMENT, MESH_PASS_DISPLAY, MESH_PASS_COUNT };
+const char* meshPassNames[MESH_PASS_COUNT] = { "Environment", "Display" };
+float meshLodError;						// Pixels a level may deviate by (0 always draws the full mesh)
+struct MeshLevelUse {
+	unsigned frames;		// Frames the pass drew the level
+	unsigned timedFrames;	// Of them with a GPU time
+	double gpuMs;			// Sum of the pass times
+};
+std::vector<MeshLevelUse> meshLevelUse[MESH_PASS_COUNT];
+// Levels drawn by the frames the GPU profiler has not collected yet (-1: pass skipped)
+std::vector<std::array<int, MESH_PASS_COUNT>> meshLevelHistory;
+unsigned meshLevelFrame;				// Frames profiled so far
 
 // Camera state
 glm::vec3 camCoords;		// Spherical coordinates (theta, phi, radius) of the camera
 bool camRot;				// Whether the camera is currently rotating
 glm::vec2 camOrigin;		// Original camera coordinates upon clicking
 glm::vec2 mouseOrigin;		// Original mouse coordinates upon clicking
+glm::vec3 camOrbit;			// Camera motion per frame (benchmark scenarios)
 
 // Constants
 const int MENU_EXIT = 0;			// Exit application
@@ -131,15 +225,27 @@ const int MAT_WATER = 2;
 const int MAT_WALL = 3;
 const int MAT_SKYBOX = 4;
 const int MAT_TERR = 5;
+const int MAT_COUNT = 6;			// Materials 0 (mesh) to MAT_TERR
 
 // Initialization functions
 void initState();
-void initGLUT(int* argc, char** argv);
+void parseArgs(int argc, char** argv);
+void initWindow(int* argc, char** argv);
+DispProgram createDispShader(bool geometryShader, int material = -1);
+void releaseDispShader(DispProgram& disp);
+const DispProgram& useDispShader(int material);
+void drawScene(const std::vector<SceneDraw>& draws);
+void benchmarkDispShaders(const glm::vec3& camPos);
+void benchmarkCausticsGrids(GLuint waterTexture, GLuint normalsTexture);
+void benchmarkObjLoaders(const std::string& path);
+void drawProfilerOverlay();
+void playBenchmark(unsigned frame);
 void initOpenGL();
 void initGeometry();
 void initTextures();
 
 void initWaterMesh();
+void initWaterBuffers();
 void initWallsMesh();
 void initWallTexture();
 void initTerrTexture();
@@ -155,16 +261,28 @@ void mouseMove(int x, int y);
 void idle();
 void menu(int cmd);
 void cleanup();
+void input(const InputJournal::Event& event);
+void dispatchInput(const InputJournal::Event& event);
 
 // Other functions
 void generateIslands();
+void writeTrace();
+bool boxOnScreen(const glm::mat4& xform, glm::vec3 minBB, glm::vec3 maxBB);
+void drawMesh(int pass, int level, GLint uniModel);
+void collectMeshLevelTimes();
 GLuint loadSkybox(std::vector<std::string> faces);
 
 int main(int argc, char** argv) {
 	try {
 		// Initialize
 		initState();
-		initGLUT(&argc, argv);
+		parseArgs(argc, argv);
+		if (!benchmarkObj.empty()) {
+			benchmarkObjLoaders(benchmarkObj);
+			cleanup();
+			return 0;
+		}
+		initWindow(&argc, argv);
 		initOpenGL();
 		initGeometry();
 		initTextures();
@@ -177,7 +295,13 @@ int main(int argc, char** argv) {
 	}
 
 	// Execute main loop
-	glutMainLoop();
+	window->run({ display,
+		[](int w, int h) { input({ InputJournal::EVENT_RESHAPE, { w, h, 0, 0 } }); },
+		[](unsigned char key, int x, int y) { input({ InputJournal::EVENT_KEY, { key, x, y, 0 } }); },
+		[](int button, int state, int x, int y) { input({ InputJournal::EVENT_MOUSE_BUTTON, { button, state, x, y } }); },
+		[](int x, int y) { input({ InputJournal::EVENT_MOUSE_MOVE, { x, y, 0, 0 } }); },
+		idle, cleanup });
+	window = NULL;
 
 	return 0;
 }
@@ -186,41 +310,70 @@ void initState() {
 	// Initialize global state
 	width = 0;
 	height = 0;
+	window = NULL;
+	headless = false;
+	headlessWidth = 800;
+	headlessHeight = 600;
+	frameLimit = 300;
 	texWidth = 512;
 	texHeight = 512;
+	normalTexWidth = texWidth;
+	normalTexHeight = texHeight;
+	simSteps = 1;
+	simStep = 0;
 
 	prevTexture = 0;
 	currTexture = 0;
 	islandsTexture = 0;
 	wallTexture = 0;
 	terrTexData = 0;
-	refractionTexture = 0;
-	reflectionTexture = 0;
 	skyboxTexture = 0;
 	environmentMap = 0;
 	causticsMap = 0;
 
 	gpgpuShader = 0;
-	dispShader = 0;
+	normalShader = 0;
+	blurShader = 0;
+	dispShader = { 0, -1, -1 };
+	dispMaterialShaders.clear();
+	dispGeometryShader = false;
+	uberShader = false;
+	benchmarkDisp = false;
+	benchmarkCaustics = false;
+	benchmarkObj = "";
+	timePasses = false;
+	profileCsv = "";
+	profileOverlay = false;
+	capturePrefix = "";
+	captureFormat = FrameCapture::FORMAT_PNG;
+	traceFile = "";
+	frameBudget = 0.0;
+	benchmark = NULL;
+	benchmarkJson = "";
+	benchmarkFrameEnd = 0;
+	journal = NULL;
 	envShader = 0;
 	causticsShader = 0;
 	debugShader = 0;
-	fbo = 0;
-
-	uniXform = 0;
-	uniClipPlane = 0;
+	renderGraph = NULL;
+	frameUniforms = NULL;
+	frameDataSource = "";
+	gpuProfiler = NULL;
+	frameCapture = NULL;
+	resolution = NULL;
+
+	uniEnvModel = 0;
 	uniMousePos = 0;
-	uniCamPos = 0;
-	uniEnvXform = 0;
-	uniCausticsXform = 0;
-	uniLightDir = 0;
-	uniLightViewXform = 0;
-	uniLightDirDisp = 0;
+	uniBlurDirection = 0;
+	uniBlurScale = 0;
+	uniBlurWeight = 0;
+	uniPhotonGrid = 0;
 
 	vao = 0;
 	vbuf = 0;
 	ibuf = 0;
 	vcount = 0;
+	sceneGeometry = NULL;
 
 	mousePos = glm::vec2(-2.0f, -2.0f);
 
@@ -230,71 +383,177 @@ void initState() {
 
 	waterVtsX = 512;
 	waterVtsY = 512;
-	waterVao = 0;
-	waterVbuf = 0;
-	waterIbuf = 0;
-	waterVcount = 0;
-	waterSurfVcount = 0;
-
-	wallVao = 0;
-	wallVbuf = 0;
-	wallIbuf = 0;
-	wallVcount = 0;
-
-	skyVao = 0;
-	skyVbuf = 0;
-	skyIbuf = 0;
-	skyVcount = 0;
+	proceduralWater = true;
+	emptyVao = 0;
+	waterBodyVcount = 0;
+	causticsGrid = 256;
+	waterSurface = NULL;
 
 	terrVtsX = 128;
 	terrVtsY = 128;
-	terrVao = 0;
-	terrVbuf = 0;
-	terrIbuf = 0;
-	terrVcount = 0;
 
 	enableTerrain = false;
 
 	lightPos = glm::vec3(1.0f, 2.0f, 1.0f);
 
+	renderedFrames = 0;
+	benchmarkTriangles = 0;
+
+	envMapDirty = true;
+	envMapXform = glm::mat4(0.0f);
+	envMapMeshOffset = glm::vec3(0.0f);
+	envMapRenders = 0;
+	envMapReuses = 0;
+
+	causticsInterval = 1;
+	causticsAge = -1;
+	causticsUpdates = 0;
+	causticsReuses = 0;
+
+	meshOffset = glm::vec3(0.0f, -0.5f, 0.0f);
+
 	mesh = NULL;
+	meshCache = true;
+	meshLodError = 1.0f;
+	for (int i = 0; i < MESH_PASS_COUNT; i++)
+		meshLevelUse[i].clear();
+	meshLevelHistory.clear();
+	meshLevelFrame = 0;
 
 	camCoords = glm::vec3(30.0f, 15.0f, 3.0f);
 	camRot = false;
+	camOrbit = glm::vec3(0.0f);
+}
+
+void parseArgs(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--water-vertex-buffers")
+			proceduralWater = false;
+		else if (arg == "--geometry-shader")
+			dispGeometryShader = true;
+		else if (arg == "--uber-shader")
+			uberShader = true;
+		else if (arg == "--time-passes")
+			timePasses = true;
+		else if (arg == "--profile-csv" && i + 1 < argc)
+			profileCsv = argv[++i];
+		else if (arg == "--profile-overlay")
+			profileOverlay = true;
+		else if (arg == "--headless" && i + 1 < argc) {
+			headless = true;
+			std::istringstream size(argv[++i]);
+			char x = 0;
+			if (!(size >> headlessWidth >> x >> headlessHeight) || x != 'x' || headlessWidth < 1 || headlessHeight < 1)
+				throw std::runtime_error("--headless needs a resolution like 1920x1080");
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			int frames = std::atoi(argv[++i]);
+			if (frames < 1)
+				throw std::runtime_error("--frames needs a positive number of frames");
+			frameLimit = unsigned(frames);
+		}
+		else if (arg == "--capture" && i + 1 < argc)
+			capturePrefix = argv[++i];
+		else if (arg == "--capture-format" && i + 1 < argc) {
+			std::string format = argv[++i];
+			if (format == "png")
+				captureFormat = FrameCapture::FORMAT_PNG;
+			else if (format == "ppm")
+				captureFormat = FrameCapture::FORMAT_PPM;
+			else throw std::runtime_error("--capture-format needs png or ppm");
+		}
+		else if (arg == "--trace" && i + 1 < argc) {
+			traceFile = argv[++i];
+			CpuTrace::enable(true);
+		}
+		else if (arg == "--frame-budget" && i + 1 < argc) {
+			frameBudget = std::atof(argv[++i]);
+			if (frameBudget <= 0.0)
+				throw std::runtime_error("--frame-budget needs a positive number of milliseconds");
+		}
+		else if (arg == "--benchmark" && i + 1 < argc) {
+			benchmark = std::make_unique<Benchmark>(argv[++i]);
+			// Same terrain in every run
+			rng = std::mt19937(benchmark->seed());
+		}
+		else if (arg == "--record" && i + 1 < argc) {
+			std::random_device rd;
+			unsigned seed = rd();
+			journal = std::make_unique<InputJournal>(argv[++i], InputJournal::MODE_RECORD, seed);
+			rng = std::mt19937(seed);
+		}
+		else if (arg == "--replay" && i + 1 < argc) {
+			journal = std::make_unique<InputJournal>(argv[++i], InputJournal::MODE_REPLAY);
+			rng = std::mt19937(journal->seed());
+		}
+		else if (arg == "--benchmark-json" && i + 1 < argc)
+			benchmarkJson = argv[++i];
+		else if (arg == "--benchmark-display")
+			benchmarkDisp = true;
+		else if (arg == "--caustics-grid" && i + 1 < argc) {
+			causticsGrid = std::atoi(argv[++i]);
+			if (causticsGrid < 1)
+				throw std::runtime_error("--caustics-grid needs a positive number of quads");
+		}
+		else if (arg == "--benchmark-caustics")
+			benchmarkCaustics = true;
+		else if (arg == "--no-mesh-cache")
+			meshCache = false;
+		else if (arg == "--mesh-lod-error" && i + 1 < argc) {
+			meshLodError = float(std::atof(argv[++i]));
+			if (meshLodError < 0.0f)
+				throw std::runtime_error("--mesh-lod-error needs a number of pixels (0 for the full mesh)");
+		}
+		else if (arg == "--benchmark-obj" && i + 1 < argc)
+			benchmarkObj = argv[++i];
+		else if (arg == "--caustics-interval" && i + 1 < argc) {
+			causticsInterval = std::atoi(argv[++i]);
+			if (causticsInterval < 1)
+				throw std::runtime_error("--caustics-interval needs a positive number of frames");
+		}
+		else if (arg == "--sim-steps" && i + 1 < argc) {
+			simSteps = std::atoi(argv[++i]);
+			if (simSteps < 1)
+				throw std::runtime_error("--sim-steps needs a positive number of steps");
+		}
+		else if (arg == "--normal-scale" && i + 1 < argc) {
+			float scale = float(std::atof(argv[++i]));
+			if (scale <= 0.0f || scale > 1.0f)
+				throw std::runtime_error("--normal-scale needs a fraction of the water resolution in (0, 1]");
+			normalTexWidth = std::max(1, int(texWidth * scale));
+			normalTexHeight = std::max(1, int(texHeight * scale));
+		}
+	}
 }
 
-void initGLUT(int* argc, char** argv) {
-	// Set window and context settings
-	width = 800; height = 600;
-	glutInit(argc, argv);
-	glutInitWindowSize(width, height);
-	glutInitContextVersion(3, 3);
-	glutInitContextProfile(GLUT_CORE_PROFILE);
-	glutInitDisplayMode(GLUT_RGBA | GLUT_DEPTH | GLUT_DOUBLE);
-	// Create the window
-	glutCreateWindow("GPU it!");
+void initWindow(int* argc, char** argv) {
+	// Create the window (or the offscreen context) with an OpenGL 3.3 core context
+	bool replay = journal && journal->replaying();
+	if (headless) {
+		width = headlessWidth; height = headlessHeight;
+		// Mouse positions only map to the same water texels at the recorded size
+		if (replay) journal->initialSize(width, height);
+		// A benchmark ends with its scenario, a replay with the recording
+		window = Window::createHeadless(width, height, benchmark || replay ? 0 : frameLimit);
+	}
+	else {
+		width = 800; height = 600;
+		if (replay) journal->initialSize(width, height);
+		window = Window::createGlut(argc, argv, width, height, "GPU it!");
+	}
 
 	// Create a menu
-	int menuTerrain = glutCreateMenu(menu);
-	glutAddMenuEntry("Toggle terrain", MENU_TERR);
-	glutAddMenuEntry("Reseed", MENU_RESEED);
-
-	glutCreateMenu(menu);
-	glutAddSubMenu("Terrain", menuTerrain);
-	glutAddMenuEntry("Exit", MENU_EXIT);
-	glutAttachMenu(GLUT_RIGHT_BUTTON);
-
-	// GLUT callbacks
-	glutDisplayFunc(display);
-	glutReshapeFunc(reshape);
-	glutKeyboardUpFunc(keyRelease);
-	glutMouseFunc(mouseBtn);
-	glutMotionFunc(mouseMove);
-	glutIdleFunc(idle);
-	glutCloseFunc(cleanup);
+	window->setMenu({
+		{ "Terrain", 0, {
+			{ "Toggle terrain", MENU_TERR, {} },
+			{ "Reseed", MENU_RESEED, {} } } },
+		{ "Exit", MENU_EXIT, {} }
+	}, [](int cmd) { input({ InputJournal::EVENT_MENU, { cmd, 0, 0, 0 } }); });
 }
 
 void initOpenGL() {
+	CPU_TRACE_SCOPE("initOpenGL");
 	// Set clear color and depth
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClearDepth(1.0f);
@@ -312,28 +571,47 @@ void initOpenGL() {
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	// Compile and link display shader
+	// Transformations and light data are shared through one uniform block
+	frameUniforms = std::make_unique<UniformRing>(0, sizeof(FrameData), VIEW_COUNT);
+	frameDataSource = loadShaderSource("glsl/frame_data.glsl");
+
+	// Compile and link display shaders
+	if (uberShader)
+		dispShader = createDispShader(dispGeometryShader);
+	else for (int m = 0; m < MAT_COUNT; m++)
+		dispMaterialShaders.push_back(createDispShader(dispGeometryShader, m));
+
 	std::vector<GLuint> shaders;
-	shaders.push_back(compileShader(GL_VERTEX_SHADER, "glsl/sh_v_disp.glsl"));
-	shaders.push_back(compileShader(GL_GEOMETRY_SHADER, "glsl/sh_g_disp.glsl"));
-	shaders.push_back(compileShader(GL_FRAGMENT_SHADER, "glsl/sh_f_disp.glsl"));
-	dispShader = linkProgram(shaders);
+
+	// Compile and link GPGPU shader
+	shaders.push_back(compileShader(GL_VERTEX_SHADER, "glsl/sh_v_gpgpu.glsl"));
+	shaders.push_back(compileShader(GL_FRAGMENT_SHADER, "glsl/sh_f_gpgpu.glsl"));
+	gpgpuShader = linkProgram(shaders);
 	// Release shader sources
 	for (auto s = shaders.begin(); s != shaders.end(); ++s)
 		glDeleteShader(*s);
 	shaders.clear();
 
-	// Compile and link GPGPU shader
+	// Compile and link water normal (height derivative) shader
 	shaders.push_back(compileShader(GL_VERTEX_SHADER, "glsl/sh_v_gpgpu.glsl"));
-	shaders.push_back(compileShader(GL_FRAGMENT_SHADER, "glsl/sh_f_gpgpu.glsl"));
-	gpgpuShader = linkProgram(shaders);
+	shaders.push_back(compileShader(GL_FRAGMENT_SHADER, "glsl/sh_f_normal.glsl"));
+	normalShader = linkProgram(shaders);
+	// Release shader sources
+	for (auto s = shaders.begin(); s != shaders.end(); ++s)
+		glDeleteShader(*s);
+	shaders.clear();
+
+	// Compile and link caustics blur shader
+	shaders.push_back(compileShader(GL_VERTEX_SHADER, "glsl/sh_v_gpgpu.glsl"));
+	shaders.push_back(compileShader(GL_FRAGMENT_SHADER, "glsl/sh_f_blur.glsl"));
+	blurShader = linkProgram(shaders);
 	// Release shader sources
 	for (auto s = shaders.begin(); s != shaders.end(); ++s)
 		glDeleteShader(*s);
 	shaders.clear();
 
 	// Compile and link environment mapping shader
-	shaders.push_back(compileShader(GL_VERTEX_SHADER, "glsl/sh_v_env.glsl"));
+	shaders.push_back(compileShader(GL_VERTEX_SHADER, "glsl/sh_v_env.glsl", frameDataSource));
 	shaders.push_back(compileShader(GL_FRAGMENT_SHADER, "glsl/sh_f_env.glsl"));
 	envShader = linkProgram(shaders);
 	// Release shader sources
@@ -342,7 +620,7 @@ void initOpenGL() {
 	shaders.clear();
 
 	// Compile and link caustics shader
-	shaders.push_back(compileShader(GL_VERTEX_SHADER, "glsl/sh_v_caustics.glsl"));
+	shaders.push_back(compileShader(GL_VERTEX_SHADER, "glsl/sh_v_caustics.glsl", frameDataSource));
 	shaders.push_back(compileShader(GL_FRAGMENT_SHADER, "glsl/sh_f_caustics.glsl"));
 	causticsShader = linkProgram(shaders);
 	// Release shader sources
@@ -359,16 +637,17 @@ void initOpenGL() {
 		glDeleteShader(*s);
 	shaders.clear();
 
+	GLuint programs[] = { gpgpuShader, normalShader, envShader, causticsShader, debugShader };
+	for (GLuint program : programs)
+		frameUniforms->attach(program, "FrameData");
+
 	// Locate uniforms
-	uniXform = glGetUniformLocation(dispShader, "xform");
-	uniClipPlane = glGetUniformLocation(dispShader, "clipPlane");
-	uniCamPos = glGetUniformLocation(dispShader, "camPos");
-	uniLightViewXform = glGetUniformLocation(dispShader, "lightViewXform");
 	uniMousePos = glGetUniformLocation(gpgpuShader, "mousePos");
-	uniEnvXform = glGetUniformLocation(envShader, "xform");
-	uniCausticsXform = glGetUniformLocation(causticsShader, "xform");
-	uniLightDir = glGetUniformLocation(causticsShader, "lightDir");
-	uniLightDirDisp = glGetUniformLocation(dispShader, "lightDir");
+	uniBlurDirection = glGetUniformLocation(blurShader, "direction");
+	uniBlurScale = glGetUniformLocation(blurShader, "scale");
+	uniBlurWeight = glGetUniformLocation(blurShader, "weight");
+	uniPhotonGrid = glGetUniformLocation(causticsShader, "photonGrid");
+	uniEnvModel = glGetUniformLocation(envShader, "model");
 
 	// Bind texture image units
 	GLuint uniTex = glGetUniformLocation(gpgpuShader, "prevTex");
@@ -379,24 +658,14 @@ void initOpenGL() {
 	uniTex = glGetUniformLocation(gpgpuShader, "islandsTex");
 	glUniform1i(uniTex, 2);
 
-	uniTex = glGetUniformLocation(dispShader, "waterTex");
-	glUseProgram(dispShader);
+
+	uniTex = glGetUniformLocation(normalShader, "waterTex");
+	glUseProgram(normalShader);
+	glUniform1i(uniTex, 0);
+
+	uniTex = glGetUniformLocation(blurShader, "image");
+	glUseProgram(blurShader);
 	glUniform1i(uniTex, 0);
-	uniTex = glGetUniformLocation(dispShader, "islandsTex");
-	glUniform1i(uniTex, 1);
-	uniTex = glGetUniformLocation(dispShader, "wallTex");
-	glUniform1i(uniTex, 2);
-	uniTex = glGetUniformLocation(dispShader, "terrTex");
-	glUniform1i(uniTex, 3);
-	uniTex = glGetUniformLocation(dispShader, "refractionTex");
-	glUniform1i(uniTex, 4);
-	uniTex = glGetUniformLocation(dispShader, "reflectionTex");
-	glUniform1i(uniTex, 5);
-	uniTex = glGetUniformLocation(dispShader, "skybox");
-	glUniform1i(uniTex, 6);
-	uniTex = glGetUniformLocation(dispShader, "causticsTex");
-	glUniform1i(uniTex, 7);
-	glUseProgram(0);
 
 	uniTex = glGetUniformLocation(envShader, "islandsTex");
 	glUseProgram(envShader);
@@ -407,6 +676,14 @@ void initOpenGL() {
 	glUniform1i(uniTex, 0);
 	uniTex = glGetUniformLocation(causticsShader, "envTex");
 	glUniform1i(uniTex, 1);
+	uniTex = glGetUniformLocation(causticsShader, "normalTex");
+	glUniform1i(uniTex, 2);
+	glUniform1i(uniPhotonGrid, causticsGrid);
+
+	// Static geometry is drawn untransformed
+	glm::mat4 identity(1.0f);
+	glUseProgram(envShader);
+	glUniformMatrix4fv(uniEnvModel, 1, GL_FALSE, value_ptr(identity));
 
 	uniTex = glGetUniformLocation(debugShader, "tex");
 	glUseProgram(debugShader);
@@ -415,6 +692,275 @@ void initOpenGL() {
 	assert(glGetError() == GL_NO_ERROR);
 }
 
+// Compile and link a display shader, with or without the geometry shader stage,
+// shading all materials or specialized for one (material >= 0)
+DispProgram createDispShader(bool geometryShader, int material) {
+	std::string defines = geometryShader ? "" : "#define NO_GEOMETRY_SHADER\n";
+	std::string fragDefines = defines;
+	if (material >= 0)
+		fragDefines += "#define MATERIAL " + std::to_string(material) + "\n";
+	std::vector<GLuint> shaders;
+	shaders.push_back(compileShader(GL_VERTEX_SHADER, "glsl/sh_v_disp.glsl", defines + frameDataSource));
+	if (geometryShader)
+		shaders.push_back(compileShader(GL_GEOMETRY_SHADER, "glsl/sh_g_disp.glsl", frameDataSource));
+	shaders.push_back(compileShader(GL_FRAGMENT_SHADER, "glsl/sh_f_disp.glsl", fragDefines + frameDataSource));
+	GLuint program = linkProgram(shaders);
+	// Release shader sources
+	for (auto s = shaders.begin(); s != shaders.end(); ++s)
+		glDeleteShader(*s);
+
+	// Uniform block, texture image units and constant uniforms
+	frameUniforms->attach(program, "FrameData");
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "waterTex"), 0);
+	glUniform1i(glGetUniformLocation(program, "islandsTex"), 1);
+	glUniform1i(glGetUniformLocation(program, "wallTex"), 2);
+	glUniform1i(glGetUniformLocation(program, "terrTex"), 3);
+	glUniform1i(glGetUniformLocation(program, "refractionTex"), 4);
+	glUniform1i(glGetUniformLocation(program, "reflectionTex"), 5);
+	glUniform1i(glGetUniformLocation(program, "skybox"), 6);
+	glUniform1i(glGetUniformLocation(program, "causticsTex"), 7);
+	glUniform1i(glGetUniformLocation(program, "normalTex"), 8);
+
+	// Static geometry is drawn untransformed
+	glm::mat4 identity(1.0f);
+	glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, value_ptr(identity));
+	glUniform1i(glGetUniformLocation(program, "waterBodyQuads"), waterVtsX - 1);
+	glUseProgram(0);
+
+	return { program, glGetUniformLocation(program, "model"), glGetUniformLocation(program, "vertexSource") };
+}
+
+void releaseDispShader(DispProgram& disp) {
+	if (disp.program) {
+		GLState::forgetProgram(disp.program);
+		glDeleteProgram(disp.program);
+	}
+	disp = { 0, -1, -1 };
+}
+
+// Bind the display shader shading a material
+const DispProgram& useDispShader(int material) {
+	const DispProgram& disp = uberShader ? dispShader : dispMaterialShaders[material];
+	GLState::useProgram(disp.program);
+	return disp;
+}
+
+// Draw static scene meshes, one multi-draw per display shader (in order of first use)
+void drawScene(const std::vector<SceneDraw>& draws) {
+	std::vector<bool> drawn(draws.size(), false);
+	std::vector<GeometryArena::Range> ranges;
+	for (size_t i = 0; i < draws.size(); i++) {
+		if (drawn[i]) continue;
+		ranges.clear();
+		for (size_t j = i; j < draws.size(); j++)
+			if (uberShader || draws[j].material == draws[i].material) {
+				ranges.push_back(draws[j].range);
+				drawn[j] = true;
+			}
+		useDispShader(draws[i].material);
+		sceneGeometry->draw(ranges);
+	}
+}
+
+// Time the water surface patches drawn by both display shader variants
+void benchmarkDispShaders(const glm::vec3& camPos) {
+	const int REPEATS = 20;
+	std::vector<CdlodSurface::Patch> patches;
+	waterSurface->select(camPos, patches);
+	benchmarkTriangles = waterSurface->drawnTriangles();
+	GLuint query;
+	glGenQueries(1, &query);
+
+	GLState::bindFramebuffer(window->framebuffer());
+	GLState::viewport(width, height);
+	GLState::bindTexture(0, GL_TEXTURE_2D, prevTexture);
+	GLState::disable(GL_CULL_FACE);
+	frameUniforms->bind(VIEW_CAMERA);
+
+	for (int variant = 0; variant < 2; variant++) {
+		bool geometryShader = variant == 0;
+		DispProgram disp = createDispShader(geometryShader, uberShader ? -1 : MAT_WATER_SURF);
+		GLState::useProgram(disp.program);
+		glUniform1i(disp.uniVertexSource, proceduralWater ? VERTEX_PATCH : VERTEX_ATTRIBUTES);
+
+		// Warm up, then time the repeated draws
+		waterSurface->draw(patches);
+		glFinish();
+		size_t triangles = waterSurface->drawnTriangles();
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		for (int i = 0; i < REPEATS; i++)
+			waterSurface->draw(patches);
+		glEndQuery(GL_TIME_ELAPSED);
+		triangles = waterSurface->drawnTriangles() - triangles;
+		GLuint64 elapsed;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+
+		double ms = elapsed * 1e-6;
+		std::cout << "Display shader " << (geometryShader ? "with" : "without") << " geometry shader: "
+			<< triangles / REPEATS << " triangles in " << ms / REPEATS << " ms ("
+			<< triangles / (ms * 1e3) << " million triangles/s)" << std::endl;
+
+		releaseDispShader(disp);
+	}
+
+	// Left out of the per-frame statistics
+	benchmarkTriangles = waterSurface->drawnTriangles() - benchmarkTriangles;
+
+	GLState::enable(GL_CULL_FACE);
+	glDeleteQueries(1, &query);
+}
+
+// Time the caustics pass for photon grids from 128 to 1024 quads per side
+void benchmarkCausticsGrids(GLuint waterTexture, GLuint normalsTexture) {
+	const int REPEATS = 10;
+	GLuint query;
+	glGenQueries(1, &query);
+
+	// Separate target, so the frame just rendered is left alone
+	GLuint target, fbo;
+	glGenTextures(1, &target);
+	GLState::bindTexture(0, GL_TEXTURE_2D, target);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8_SNORM, texWidth, texHeight, 0, GL_RGBA, GL_BYTE, NULL);
+	glGenFramebuffers(1, &fbo);
+	GLState::bindFramebuffer(fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+	GLState::viewport(texWidth, texHeight);
+	// Timed with the blend state of the caustics pass
+	bool blend = GLState::isEnabled(GL_BLEND);
+	if (CAUSTICS_PASS_STATE.blend) GLState::enable(GL_BLEND);
+	else GLState::disable(GL_BLEND);
+
+	GLState::useProgram(causticsShader);
+	frameUniforms->bind(VIEW_CAMERA);
+	GLState::bindTexture(0, GL_TEXTURE_2D, waterTexture);
+	GLState::bindTexture(1, GL_TEXTURE_2D, environmentMap);
+	GLState::bindTexture(2, GL_TEXTURE_2D, normalsTexture);
+	GLState::bindVertexArray(emptyVao);
+
+	for (int grid = 128; grid <= 1024; grid *= 2) {
+		glUniform1i(uniPhotonGrid, grid);
+		GLsizei count = grid * grid * 6;
+
+		// Warm up, then time the repeated passes
+		glClear(GL_COLOR_BUFFER_BIT);
+		glDrawArrays(GL_TRIANGLES, 0, count);
+		glFinish();
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		for (int i = 0; i < REPEATS; i++) {
+			glClear(GL_COLOR_BUFFER_BIT);
+			glDrawArrays(GL_TRIANGLES, 0, count);
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+		GLuint64 elapsed;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+
+		std::cout << "Caustics with a " << grid << "x" << grid << " photon grid: "
+			<< elapsed * 1e-6 / REPEATS << " ms" << std::endl;
+	}
+	glUniform1i(uniPhotonGrid, causticsGrid);
+
+	if (blend) GLState::enable(GL_BLEND);
+	else GLState::disable(GL_BLEND);
+	GLState::forgetFramebuffer(fbo);
+	glDeleteFramebuffers(1, &fbo);
+	GLState::forgetTexture(target);
+	glDeleteTextures(1, &target);
+	glDeleteQueries(1, &query);
+}
+
+// Load an OBJ file with the stream loader and the mapped loader (on one
+// thread and on all cores), check they agree and print their throughput
+void benchmarkObjLoaders(const std::string& path) {
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		throw std::runtime_error("Could not open " + path);
+	double megabytes = double(file.tellg()) / (1024.0 * 1024.0);
+	file.close();
+
+	// Best of a few runs, so the file is in the page cache for all loaders
+	const int runs = 3;
+	auto time = [&](const std::function<ObjGeometry()>& load, ObjGeometry& result) {
+		double best = std::numeric_limits<double>::max();
+		for (int r = 0; r < runs; r++) {
+			auto start = std::chrono::steady_clock::now();
+			result = load();
+			best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+		return best;
+	};
+	ObjGeometry stream, mapped, parallel;
+	double streamSeconds = time([&]() { return loadObjStream(path); }, stream);
+	double mappedSeconds = time([&]() { return loadObj(path, 1); }, mapped);
+	double parallelSeconds = time([&]() { return loadObj(path); }, parallel);
+
+	auto same = [](const ObjGeometry& a, const ObjGeometry& b) {
+		return a.positions == b.positions && a.normals == b.normals && a.positionIndices == b.positionIndices
+			&& a.normalIndices == b.normalIndices && a.minBB == b.minBB && a.maxBB == b.maxBB;
+	};
+	bool identical = same(stream, mapped) && same(stream, parallel);
+
+	std::cout << std::fixed << std::setprecision(1) << "OBJ loading of " << path << " (" << megabytes << " MB, "
+		<< stream.positions.size() << " vertices, " << stream.positionIndices.size() / 3 << " triangles):" << std::endl;
+	std::cout << "  stream loader:             " << std::setw(8) << megabytes / streamSeconds << " MB/s" << std::endl;
+	std::cout << "  mapped loader, 1 thread:   " << std::setw(8) << megabytes / mappedSeconds << " MB/s ("
+		<< streamSeconds / mappedSeconds << "x)" << std::endl;
+	std::cout << "  mapped loader, all cores:  " << std::setw(8) << megabytes / parallelSeconds << " MB/s ("
+		<< streamSeconds / parallelSeconds << "x, " << std::max(std::thread::hardware_concurrency(), 1u) << " cores)" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+	std::cout << std::setprecision(6) << "  results " << (identical ? "identical" : "DIFFER") << std::endl;
+}
+
+// Stacked bars of the GPU time per pass along the bottom of the window: p50 below, p95 above,
+// both scaled so the sum of the p95 times spans the window. The core profile has no bitmap
+// font drawing, so the pass names and times (in bar order) go to the window title instead.
+void drawProfilerOverlay() {
+	static const glm::vec3 colors[] = {
+		{ 0.9f, 0.3f, 0.3f }, { 0.3f, 0.8f, 0.3f }, { 0.3f, 0.5f, 0.9f }, { 0.9f, 0.8f, 0.2f },
+		{ 0.8f, 0.4f, 0.9f }, { 0.2f, 0.8f, 0.8f }, { 0.9f, 0.6f, 0.3f }, { 0.7f, 0.7f, 0.7f },
+		{ 0.5f, 0.9f, 0.7f }, { 0.6f, 0.4f, 0.3f }, { 0.9f, 0.5f, 0.7f }, { 0.4f, 0.4f, 0.9f }
+	};
+	const int colorCount = int(sizeof(colors) / sizeof(colors[0]));
+	const GLint barHeight = 8;
+
+	std::vector<std::string> names = gpuProfiler->zoneNames();
+	double totalMs = 0.0;
+	for (auto n = names.begin(); n != names.end(); ++n)
+		totalMs += gpuProfiler->percentileMs(*n, 95.0);
+	if (totalMs <= 0.0) return;
+
+	GLState::bindFramebuffer(window->framebuffer());
+	GLState::viewport(width, height);
+	GLState::enable(GL_SCISSOR_TEST);
+	for (int row = 0; row < 2; row++) {
+		double percentile = row == 0 ? 50.0 : 95.0;
+		double startMs = 0.0;
+		for (int i = 0; i < int(names.size()); i++) {
+			double ms = gpuProfiler->percentileMs(names[i], percentile);
+			GLint x0 = GLint(startMs / totalMs * width);
+			GLint x1 = GLint((startMs + ms) / totalMs * width);
+			startMs += ms;
+			if (x1 <= x0) continue;
+			const glm::vec3& c = colors[i % colorCount];
+			glScissor(x0, row * barHeight, x1 - x0, barHeight);
+			glClearColor(c.r, c.g, c.b, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+	}
+	GLState::disable(GL_SCISSOR_TEST);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+	// Refresh the title about twice a second (at 60 fps)
+	if (renderedFrames % 30 == 0) {
+		std::ostringstream title;
+		title << "GPU ms p50/p95:" << std::fixed << std::setprecision(2);
+		for (auto n = names.begin(); n != names.end(); ++n)
+			title << " | " << *n << " " << gpuProfiler->percentileMs(*n, 50.0) << "/" << gpuProfiler->percentileMs(*n, 95.0);
+		window->setTitle(title.str());
+	}
+}
+
 void initGeometry() {
 	// Vertex format
 	struct vert {
@@ -458,13 +1004,38 @@ void initGeometry() {
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
+	// Static scene geometry shares one set of buffers
+	sceneGeometry = std::make_unique<GeometryArena>(sizeof(::vert));
+	sceneGeometry->addAttribute(0, 3, GL_FLOAT, offsetof(::vert, pos));
+	sceneGeometry->addAttribute(1, 2, GL_FLOAT, offsetof(::vert, tc));
+	sceneGeometry->addIntAttribute(2, 1, GL_INT, offsetof(::vert, material));
 	initWaterMesh();
 	initWallsMesh();
 	initSkybox();
 	initTerrain();
+	sceneGeometry->upload();
 }
 
 void initWaterMesh() {
+	// For the caustics photon grid (and the water body if procedural)
+	glGenVertexArrays(1, &emptyVao);
+
+	if (proceduralWater) {
+		// Bottom quad and the quads along the four sides, see sh_v_disp.glsl
+		waterBodyVcount = 6 + 4 * (waterVtsX - 1) * 6;
+	}
+	else initWaterBuffers();
+
+	// Surface patches, the finest level matching the resolution of the grid above
+	int levels = 1;
+	while ((CdlodSurface::PATCH_QUADS << (levels - 1)) < int(waterVtsX - 1))
+		levels++;
+	waterSurface = std::make_unique<CdlodSurface>(glm::vec2(-1.0f), 2.0f, 0.16f, levels, 2.0f, MAT_WATER_SURF, proceduralWater);
+}
+
+void initWaterBuffers() {
+	std::vector<vert> waterVerts;
+	std::vector<GLuint> waterIds;
 	// Surface
 	for (unsigned j = 0; j < waterVtsY; j++) {
 		for (unsigned i = 0; i < waterVtsX; i++) {
@@ -474,7 +1045,6 @@ void initWaterMesh() {
 				MAT_WATER_SURF
 			};
 			waterVerts.push_back(v);
-			waterSurfVerts.push_back(v);
 		}
 	}
 	// Bottom
@@ -489,24 +1059,7 @@ void initWaterMesh() {
 		}
 	}
 
-	// Vertex indices for triangles
-	// Surface
-	for (unsigned i = 0; i < waterVtsX * waterVtsY - waterVtsX; i++) {
-		if (i % waterVtsY == (waterVtsY - 1))	continue;
-		waterIds.push_back(i);
-		waterSurfIds.push_back(i);
-		waterIds.push_back(i + waterVtsX);
-		waterSurfIds.push_back(i + waterVtsX);
-		waterIds.push_back(i + 1);
-		waterSurfIds.push_back(i + 1);
-
-		waterIds.push_back(i + 1);
-		waterSurfIds.push_back(i + 1);
-		waterIds.push_back(i + waterVtsX);
-		waterSurfIds.push_back(i + waterVtsX);
-		waterIds.push_back(i + waterVtsX + 1);
-		waterSurfIds.push_back(i + waterVtsX + 1);
-	}
+	// Vertex indices for triangles (the surface itself is a CdlodSurface)
 	// Bottom
 	for (unsigned i = 0; i < waterVtsX * waterVtsY - waterVtsX; i++) {
 		if (i % waterVtsY == (waterVtsY - 1))	continue;
@@ -559,68 +1112,11 @@ void initWaterMesh() {
 		waterIds.push_back(waterVtsX * waterVtsY + i + waterVtsX);
 	}
 
-	waterVcount = int(waterIds.size());
-	waterSurfVcount = int(waterSurfIds.size());
-
-	// Create vertex array object
-	glGenVertexArrays(1, &waterVao);
-	glBindVertexArray(waterVao);
-
-	// Create vertex buffer
-	glGenBuffers(1, &waterVbuf);
-	glBindBuffer(GL_ARRAY_BUFFER, waterVbuf);
-	glBufferData(GL_ARRAY_BUFFER, waterVerts.size() * sizeof(vert), waterVerts.data(), GL_DYNAMIC_DRAW);
-	// Specify vertex attributes
-	GLubyte* offset = nullptr;
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	offset += sizeof(glm::vec3);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	offset += sizeof(glm::vec2);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	// Create index buffer
-	glGenBuffers(1, &waterIbuf);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, waterIbuf);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, waterIds.size() * sizeof(GLuint), waterIds.data(), GL_DYNAMIC_DRAW);
-
-	// Cleanup state
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-	// Create vertex array object
-	glGenVertexArrays(1, &waterSurfVao);
-	glBindVertexArray(waterSurfVao);
-
-	// Create vertex buffer
-	glGenBuffers(1, &waterSurfVbuf);
-	glBindBuffer(GL_ARRAY_BUFFER, waterSurfVbuf);
-	glBufferData(GL_ARRAY_BUFFER, waterSurfVerts.size() * sizeof(vert), waterSurfVerts.data(), GL_DYNAMIC_DRAW);
-	// Specify vertex attributes
-	offset = nullptr;
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	offset += sizeof(glm::vec3);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	offset += sizeof(glm::vec2);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	// Create index buffer
-	glGenBuffers(1, &waterSurfIbuf);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, waterSurfIbuf);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, waterSurfIds.size() * sizeof(GLuint), waterSurfIds.data(), GL_DYNAMIC_DRAW);
-
-	// Cleanup state
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	waterRange = sceneGeometry->add(waterVerts.data(), GLsizei(waterVerts.size()), waterIds);
 }
 
 void initWallsMesh() {
-	wallVerts = {
+	std::vector<vert> wallVerts = {
 		{ {-1.001f,  0.3f,   -1.001f}, {0.0f, 0.0f}, MAT_WALL },
 		{ { 1.001f,  0.3f,   -1.001f}, {1.0f, 0.0f}, MAT_WALL },
 		{ {-1.001f, -1.001f, -1.001f}, {0.0f, 0.8f}, MAT_WALL },
@@ -647,46 +1143,18 @@ void initWallsMesh() {
 		{ { 1.001f, -1.001f,  1.001f}, {1.0f, 1.0f}, MAT_WALL }
 	};
 	// Vertex indices for triangles
-	wallIds = {
+	std::vector<GLuint> wallIds = {
 		 0,  2,  1,  1,  2,  3,
 		 4,  6,  7,  4,  7,  5,
 		 8, 10, 11,  9,  8, 11,
 		12, 14, 13, 13, 14, 15,
 		16, 18, 19, 16, 19, 17
 	};
-	wallVcount = int(wallIds.size());
-
-	// Create vertex array object
-	glGenVertexArrays(1, &wallVao);
-	glBindVertexArray(wallVao);
-
-	// Create vertex buffer
-	glGenBuffers(1, &wallVbuf);
-	glBindBuffer(GL_ARRAY_BUFFER, wallVbuf);
-	glBufferData(GL_ARRAY_BUFFER, wallVerts.size() * sizeof(vert), wallVerts.data(), GL_DYNAMIC_DRAW);
-	// Specify vertex attributes
-	GLubyte* offset = nullptr;
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	offset += sizeof(glm::vec3);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	offset += sizeof(glm::vec2);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	// Create index buffer
-	glGenBuffers(1, &wallIbuf);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, wallIbuf);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, wallIds.size() * sizeof(GLuint), wallIds.data(), GL_DYNAMIC_DRAW);
-
-	// Cleanup state
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	wallRange = sceneGeometry->add(wallVerts.data(), GLsizei(wallVerts.size()), wallIds);
 }
 
 void initSkybox() {
-	skyVerts = {
+	std::vector<vert> skyVerts = {
 		{ {-10.0f,  10.0f, -10.0f}, {0.0f, 0.0f}, MAT_SKYBOX },
 		{ { 10.0f,  10.0f, -10.0f}, {1.0f, 0.0f}, MAT_SKYBOX },
 		{ {-10.0f, -10.0f, -10.0f}, {0.0f, 0.8f}, MAT_SKYBOX },
@@ -718,7 +1186,7 @@ void initSkybox() {
 		{ { 10.0f,  10.0f,  10.0f}, {1.0f, 1.0f}, MAT_SKYBOX }
 	};
 	// Vertex indices for triangles
-	skyIds = {
+	std::vector<GLuint> skyIds = {
 		 0,  2,  1,  1,  2,  3,
 		 4,  6,  7,  4,  7,  5,
 		 8, 10, 11,  9,  8, 11,
@@ -726,38 +1194,12 @@ void initSkybox() {
 		16, 18, 19, 16, 19, 17,
 		20, 21, 23, 20, 23, 22
 	};
-	skyVcount = int(skyIds.size());
-
-	// Create vertex array object
-	glGenVertexArrays(1, &skyVao);
-	glBindVertexArray(skyVao);
-
-	// Create vertex buffer
-	glGenBuffers(1, &skyVbuf);
-	glBindBuffer(GL_ARRAY_BUFFER, skyVbuf);
-	glBufferData(GL_ARRAY_BUFFER, skyVerts.size() * sizeof(vert), skyVerts.data(), GL_DYNAMIC_DRAW);
-	// Specify vertex attributes
-	GLubyte* offset = nullptr;
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	offset += sizeof(glm::vec3);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	offset += sizeof(glm::vec2);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	// Create index buffer
-	glGenBuffers(1, &skyIbuf);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skyIbuf);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, skyIds.size() * sizeof(GLuint), skyIds.data(), GL_DYNAMIC_DRAW);
-
-	// Cleanup state
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	skyRange = sceneGeometry->add(skyVerts.data(), GLsizei(skyVerts.size()), skyIds);
 }
 
 void initTerrain() {
+	std::vector<vert> terrVerts;
+	std::vector<GLuint> terrIds;
 	for (unsigned j = 0; j < terrVtsY; j++) {
 		for (unsigned i = 0; i < terrVtsX; i++) {
 			vert v = {
@@ -781,50 +1223,20 @@ void initTerrain() {
 		terrIds.push_back(i + terrVtsX + 1);
 	}
 
-	terrVcount = int(terrIds.size());
-
-	// Create vertex array object
-	glGenVertexArrays(1, &terrVao);
-	glBindVertexArray(terrVao);
-
-	// Create vertex buffer
-	glGenBuffers(1, &terrVbuf);
-	glBindBuffer(GL_ARRAY_BUFFER, terrVbuf);
-	glBufferData(GL_ARRAY_BUFFER, terrVerts.size() * sizeof(vert), terrVerts.data(), GL_DYNAMIC_DRAW);
-	// Specify vertex attributes
-	GLubyte* offset = nullptr;
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	offset += sizeof(glm::vec3);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	offset += sizeof(glm::vec2);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(vert), offset);
-	// Create index buffer
-	glGenBuffers(1, &terrIbuf);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrIbuf);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, terrIds.size() * sizeof(GLuint), terrIds.data(), GL_DYNAMIC_DRAW);
-
-	// Cleanup state
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	terrRange = sceneGeometry->add(terrVerts.data(), GLsizei(terrVerts.size()), terrIds);
 }
 
 void initTextures() {
+	CPU_TRACE_SCOPE("initTextures");
 	// Create texture data
-	initTexData = std::vector<glm::u8vec3>(texWidth * texHeight, glm::u8vec3(0, 0, 0));
+	initTexData = std::vector<float>(texWidth * texHeight, 0.0f);
 	islandsTexData = std::vector<glm::u8vec3>(texWidth * texHeight, glm::u8vec3(255, 255, 255));
-	refractionTexData = std::vector<glm::u8vec3>(texWidth * texHeight, glm::u8vec3(0, 0, 0));
-	reflectionTexData = std::vector<glm::u8vec3>(texWidth * texHeight, glm::u8vec3(0, 0, 0));
-	envMapData = std::vector<glm::u8vec4>(texWidth * texHeight, glm::u8vec4(0, 0, 0, 0));
-	causticsMapData = std::vector<glm::u8vec4>(texWidth * texHeight, glm::u8vec4(0, 0, 0, 0));
 
 	// Create texture objects
+	// Water height only (single channel), normals are derived in their own pass
 	glGenTextures(1, &prevTexture);
 	glBindTexture(GL_TEXTURE_2D, prevTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8_SNORM, texWidth, texHeight, 0, GL_RGB, GL_BYTE, initTexData.data());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, texWidth, texHeight, 0, GL_RED, GL_FLOAT, initTexData.data());
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -832,23 +1244,7 @@ void initTextures() {
 
 	glGenTextures(1, &currTexture);
 	glBindTexture(GL_TEXTURE_2D, currTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8_SNORM, texWidth, texHeight, 0, GL_RGB, GL_BYTE, initTexData.data());
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	glGenTextures(1, &refractionTexture);
-	glBindTexture(GL_TEXTURE_2D, refractionTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texWidth, texHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, refractionTexData.data());
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	glGenTextures(1, &reflectionTexture);
-	glBindTexture(GL_TEXTURE_2D, reflectionTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texWidth, texHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, reflectionTexData.data());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, texWidth, texHeight, 0, GL_RED, GL_FLOAT, initTexData.data());
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -856,7 +1252,7 @@ void initTextures() {
 
 	glGenTextures(1, &environmentMap);
 	glBindTexture(GL_TEXTURE_2D, environmentMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8_SNORM, texWidth, texHeight, 0, GL_RGBA, GL_BYTE, envMapData.data());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8_SNORM, texWidth, texHeight, 0, GL_RGBA, GL_BYTE, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -864,9 +1260,11 @@ void initTextures() {
 
 	glGenTextures(1, &causticsMap);
 	glBindTexture(GL_TEXTURE_2D, causticsMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8_SNORM, texWidth, texHeight, 0, GL_RGBA, GL_BYTE, causticsMapData.data());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, texWidth, texHeight, 0, GL_RG, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
 	std::vector<std::string> faces{
 		"textures/skyboxRight.png",  "textures/skyboxLeft.png",  "textures/skyboxTop.png",
@@ -880,10 +1278,39 @@ void initTextures() {
 	initTerrTexture();
 	generateIslands();
 
-	// Create framebuffer object (draw to currTexture)
-	glGenFramebuffers(1, &fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, currTexture, 0);
+	// Render targets other than the water heights are owned by the render graph
+	renderGraph = std::make_unique<RenderGraph>();
+	if (timePasses || !profileCsv.empty() || profileOverlay || frameBudget > 0.0 || benchmark) {
+		gpuProfiler = std::make_unique<GpuProfiler>();
+		meshLevelHistory.assign(gpuProfiler->latency(), std::array<int, MESH_PASS_COUNT>());
+		for (auto frame = meshLevelHistory.begin(); frame != meshLevelHistory.end(); ++frame)
+			frame->fill(-1);
+		renderGraph->setPassHooks(
+			[](const std::string& name) { gpuProfiler->begin(name); },
+			[](const std::string&) { gpuProfiler->end(); });
+		if (!profileCsv.empty())
+			gpuProfiler->logCsv(profileCsv);
+	}
+	if (frameBudget > 0.0)
+		resolution = std::make_unique<ResolutionController>(frameBudget, gpuProfiler->latency());
+	if (benchmark) {
+		// Context of the run, so summaries from different builds and machines can be compared
+		const GLubyte* renderer = glGetString(GL_RENDERER);
+		const GLubyte* version = glGetString(GL_VERSION);
+		benchmark->describe("renderer", renderer ? (const char*)renderer : "");
+		benchmark->describe("glVersion", version ? (const char*)version : "");
+		benchmark->describe("window", (headless ? "headless " : "glut ") + std::to_string(width) + "x" + std::to_string(height));
+		benchmark->describe("water", proceduralWater ? "procedural" : "vertex buffers");
+		benchmark->describe("displayShader", std::string(uberShader ? "uber" : "per material")
+			+ (dispGeometryShader ? " with geometry shader" : ""));
+		benchmark->describe("caustics", "grid " + std::to_string(causticsGrid) + ", interval " + std::to_string(causticsInterval));
+		benchmark->describe("frameBudget", frameBudget > 0.0 ? std::to_string(frameBudget) + " ms" : "off");
+	}
+	if (!capturePrefix.empty())
+		frameCapture = std::make_unique<FrameCapture>(capturePrefix, captureFormat);
+
+	// Bindings were changed directly during initialization
+	GLState::invalidate();
 
 	assert(glGetError() == GL_NO_ERROR);
 }
@@ -928,94 +1355,57 @@ void initTerrTexture() {
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-void display() {
-	try {
-		// Pass 1: GPGPU output to texture =============================
-
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);		// Enable render-to-texture
-		glViewport(0, 0, texWidth, texHeight);		// Reshape to texture size
-		glUseProgram(gpgpuShader);
-
-		// Mouse position for interaction
-		// I have no idea about ray-casting mouse interaction
-		// So I would just keep the mouse to texture coordinate interaction
-		glUniform2fv(uniMousePos, 1, value_ptr(mousePos));
-
-		// Use the previous texture output as input
-		glActiveTexture(GL_TEXTURE0 + 0);
-		glBindTexture(GL_TEXTURE_2D, prevTexture);
-		glActiveTexture(GL_TEXTURE0 + 1);
-		glBindTexture(GL_TEXTURE_2D, currTexture);
-		glActiveTexture(GL_TEXTURE0 + 2);
-		glBindTexture(GL_TEXTURE_2D, islandsTexture);
-		// Draw the quad to invoke the shader
-		glBindVertexArray(vao);
-		glDrawElements(GL_TRIANGLES, vcount, GL_UNSIGNED_INT, NULL);
-		glBindVertexArray(0);
+// Draw a level of the mesh in a pass and note it for the report
+void drawMesh(int pass, int level, GLint uniModel) {
+	mesh->draw(uniModel, level);
+	if (meshLevelUse[pass].size() < size_t(mesh->levelCount()))
+		meshLevelUse[pass].resize(mesh->levelCount(), MeshLevelUse());
+	meshLevelUse[pass][level].frames++;
+	if (!meshLevelHistory.empty())
+		meshLevelHistory[meshLevelFrame % meshLevelHistory.size()][pass] = level;
+}
 
-		// Pass 1.1: Environment Mapping =============================
+// The profiler has just collected the pass times of latency - 1 frames ago,
+// whose levels are in the same slot of the history the next frame writes to
+void collectMeshLevelTimes() {
+	const std::array<int, MESH_PASS_COUNT>& levels = meshLevelHistory[meshLevelFrame % meshLevelHistory.size()];
+	for (int pass = 0; pass < MESH_PASS_COUNT; pass++) {
+		if (levels[pass] < 0) continue;
+		double ms = gpuProfiler->lastMs(meshPassNames[pass]);
+		if (ms <= 0.0) continue;
+		meshLevelUse[pass][levels[pass]].timedFrames++;
+		meshLevelUse[pass][levels[pass]].gpuMs += ms;
+	}
+}
 
+void display() {
+	CPU_TRACE_SCOPE("display");
+	try {
 		// Load model on demand
-		if (!mesh) mesh = std::make_unique<Mesh>("models/bunny.obj");
-
-		glDisable(GL_BLEND);
-		glUseProgram(envShader);
-		
-		glm::mat4 proj = glm::ortho(-2.0f, 2.0f, -2.0f, 2.0f, 1.0f, 100.0f);
-		glm::mat4 view = glm::lookAt(lightPos, glm::vec3(0.0f),glm::vec3(0.0f, 0.1f, 0.0f));
-		glm::mat4 xform = proj * view;
-		glm::mat4 lightViewXform = xform;
+		if (!mesh) mesh = std::make_unique<Mesh>("models/bunny.obj", meshCache);
 
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, environmentMap, 0);
-
-		// Send transformation matrix to shader
-		glUniformMatrix4fv(uniEnvXform, 1, GL_FALSE, value_ptr(lightViewXform));
-
-		// Clear the texture
-		glClear(GL_COLOR_BUFFER_BIT);
-		// Enable terrain texture
-		glActiveTexture(GL_TEXTURE0 + 0);
-		glBindTexture(GL_TEXTURE_2D, islandsTexture);
-		// Draw the scene (double-sided walls and double-sided terrain)
-		glDisable(GL_CULL_FACE);
-		mesh->move(0.0f, -0.5f, 0.0f);
-		mesh->draw();
-		glBindVertexArray(wallVao);
-		glDrawElements(GL_TRIANGLES, wallVcount, GL_UNSIGNED_INT, NULL);
-		if (enableTerrain) {
-			glBindVertexArray(terrVao);
-			glDrawElements(GL_TRIANGLES, terrVcount, GL_UNSIGNED_INT, NULL);
+		if (benchmark) {
+			if (!benchmarkFrameEnd) benchmarkFrameEnd = CpuTrace::now();
+			playBenchmark(window->frameCount());
 		}
-		glEnable(GL_CULL_FACE);
-
-		// Pass 1.2: Caustics Mapping =============================
 
-		glUseProgram(causticsShader);
-
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, causticsMap, 0);
+		if (journal && journal->replaying()) {
+			std::vector<InputJournal::Event> events = journal->due(simStep);
+			if (journal->ended(simStep)) {
+				window->requestExit();
+				return;
+			}
+			for (auto e = events.begin(); e != events.end(); ++e)
+				dispatchInput(*e);
+		}
 
+		// Light space transformation
+		glm::mat4 proj = glm::ortho(-2.0f, 2.0f, -2.0f, 2.0f, 1.0f, 100.0f);
+		glm::mat4 view = glm::lookAt(lightPos, glm::vec3(0.0f),glm::vec3(0.0f, 0.1f, 0.0f));
+		glm::mat4 lightViewXform = proj * view;
 		glm::vec3 lightDir = -glm::normalize(lightPos);
-		glUniform3fv(uniLightDir, 1, value_ptr(lightDir));
-
-		// Send transformation matrix to shader
-		glUniformMatrix4fv(uniCausticsXform, 1, GL_FALSE, value_ptr(lightViewXform));
-
-		// Clear the texture
-		glClear(GL_COLOR_BUFFER_BIT);
-		// Enable terrain texture
-		glActiveTexture(GL_TEXTURE0 + 0);
-		glBindTexture(GL_TEXTURE_2D, prevTexture);
-		glActiveTexture(GL_TEXTURE0 + 1);
-		glBindTexture(GL_TEXTURE_2D, environmentMap);
-		// Draw the scene (water)
-		glBindVertexArray(waterSurfVao);
-		glDrawElements(GL_TRIANGLES, waterSurfVcount, GL_UNSIGNED_INT, NULL);
-
-		glEnable(GL_BLEND);
-
-		// Pass 2: Refraction ===============================
-
-		glUseProgram(dispShader);
+		// The orthographic light view covers the environment map at the same scale everywhere
+		int envMeshLevel = mesh->selectLevel(proj[1][1] * texHeight * 0.5f, meshLodError);
 
 		float aspect = (float)width / (float)height;
 		// Create perspective projection matrix
@@ -1024,138 +1414,393 @@ void display() {
 		view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.0, -camCoords.z));
 		glm::mat4 rot = glm::rotate(glm::mat4(1.0f), glm::radians(camCoords.y), glm::vec3(1.0, 0.0, 0.0));
 		rot = glm::rotate(rot, glm::radians(camCoords.x), glm::vec3(0.0, 1.0, 0.0));
-		xform = proj * view * rot;
+		glm::mat4 xform = proj * view * rot;
+		glm::mat4 camRot = rot;
+
+		// Flipped camera for the reflection
+		rot = glm::rotate(glm::mat4(1.0f), -glm::radians(camCoords.y), glm::vec3(1.0, 0.0, 0.0));
+		rot = glm::rotate(rot, glm::radians(camCoords.x), glm::vec3(0.0, 1.0, 0.0));
+		glm::mat4 xformRflect = proj * view * rot;
 
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, refractionTexture, 0);
+		// Per-frame and per-view shader data
+		FrameData frameData[VIEW_COUNT];
+		for (int i = 0; i < VIEW_COUNT; i++) {
+			frameData[i].lightViewXform = lightViewXform;
+			frameData[i].lightDir = lightDir;
+			// Benchmarks advance at a fixed 60 frames per second
+			frameData[i].time = benchmark ? window->frameCount() / 60.0f : float(window->elapsedSeconds());
+			frameData[i].pad = 0.0f;
+		}
+		frameData[VIEW_CAMERA].xform = xform;
+		frameData[VIEW_CAMERA].camPos = glm::vec3(glm::inverse(view * camRot) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		frameData[VIEW_CAMERA].clipPlane = glm::vec4(0.0f);
+		// Clip water surface
+		frameData[VIEW_REFLECTION].xform = xformRflect;
+		frameData[VIEW_REFLECTION].camPos = glm::vec3(glm::inverse(view * rot) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		frameData[VIEW_REFLECTION].clipPlane = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+		frameUniforms->update(frameData);
+
+		// Refraction and reflection are only sampled by the water surface
+		bool waterOnScreen = boxOnScreen(xform, glm::vec3(-1.0f, -0.16f, -1.0f), glm::vec3(1.0f, 0.16f, 1.0f));
+
+		// Water surface patches in view (the caustics pass has its own photon grid)
+		glm::vec3 camPos = frameData[VIEW_CAMERA].camPos;
+		std::vector<CdlodSurface::Patch> waterPatches;
+		waterSurface->select(camPos, waterPatches, [&](glm::vec3 minBB, glm::vec3 maxBB) {
+			return boxOnScreen(xform, minBB, maxBB);
+		});
+
+		if (benchmarkDisp) {
+			benchmarkDispShaders(camPos);
+			benchmarkDisp = false;
+		}
 
-		// Send transformation matrix to shader
-		glUniformMatrix4fv(uniXform, 1, GL_FALSE, value_ptr(xform));
+		// Pixels per model unit at the point of the mesh nearest to the camera
+		std::pair<glm::vec3, glm::vec3> meshBox = mesh->boundingBox();
+		glm::vec3 meshCenter = 0.5f * (meshBox.first + meshBox.second) + meshOffset;
+		float meshDistance = glm::length(camPos - meshCenter) - 0.5f * glm::length(meshBox.second - meshBox.first);
+		int dispMeshLevel = mesh->selectLevel(proj[1][1] * height * 0.5f / std::max(meshDistance, 0.1f), meshLodError);
+		if (!meshLevelHistory.empty())
+			meshLevelHistory[meshLevelFrame % meshLevelHistory.size()].fill(-1);
 
-		// Clear the texture
-		glClear(GL_COLOR_BUFFER_BIT);
-		// Draw the textures
-		glActiveTexture(GL_TEXTURE0 + 1);
-		glBindTexture(GL_TEXTURE_2D, islandsTexture);
-		glActiveTexture(GL_TEXTURE0 + 2);
-		glBindTexture(GL_TEXTURE_2D, wallTexture);
-		glActiveTexture(GL_TEXTURE0 + 3);
-		glBindTexture(GL_TEXTURE_2D, terrTexture);
-		glActiveTexture(GL_TEXTURE0 + 6);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-		glActiveTexture(GL_TEXTURE0 + 7);
-		glBindTexture(GL_TEXTURE_2D, causticsMap);
-		// Draw the scene (skybox, walls and terrain)
-		glBindVertexArray(skyVao);
-		glDrawElements(GL_TRIANGLES, skyVcount, GL_UNSIGNED_INT, NULL);
-		glBindVertexArray(wallVao);
-		glDrawElements(GL_TRIANGLES, wallVcount, GL_UNSIGNED_INT, NULL);
-		if (enableTerrain) {
-			glBindVertexArray(terrVao);
-			glDrawElements(GL_TRIANGLES, terrVcount, GL_UNSIGNED_INT, NULL);
+		renderGraph->beginFrame();
+		typedef RenderGraph::Resource Resource;
+
+		// Pass 1: GPGPU output to texture =============================
+
+		Resource water = renderGraph->importTexture("water", prevTexture, texWidth, texHeight);
+		Resource waterOld = renderGraph->importTexture("waterOld", currTexture, texWidth, texHeight);
+		for (int step = 0; step < simSteps; step++) {
+			// Written over the older heights (prevTexture holds the latest afterwards)
+			Resource waterNext = renderGraph->importTexture("water", currTexture, texWidth, texHeight);
+			renderGraph->addPass("Simulation", { water, waterOld }, { waterNext }, { 0, false }, [=]() {
+				GLState::useProgram(gpgpuShader);
+
+				// Mouse position for interaction
+				// I have no idea about ray-casting mouse interaction
+				// So I would just keep the mouse to texture coordinate interaction
+				glUniform2fv(uniMousePos, 1, value_ptr(mousePos));
+
+				// Use the previous texture output as input
+				GLState::bindTexture(0, GL_TEXTURE_2D, renderGraph->texture(water));
+				GLState::bindTexture(1, GL_TEXTURE_2D, renderGraph->texture(waterOld));
+				GLState::bindTexture(2, GL_TEXTURE_2D, islandsTexture);
+				// Draw the quad to invoke the shader
+				GLState::bindVertexArray(vao);
+				glDrawElements(GL_TRIANGLES, vcount, GL_UNSIGNED_INT, NULL);
+			});
+			waterOld = water;
+			water = waterNext;
+			std::swap(prevTexture, currTexture);
 		}
+		simStep += simSteps;
 
-		// Pass 3: Reflection ===============================
+		// Pass 1.05: Water normals (height gradient) ==================
 
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, reflectionTexture, 0);
+		// Derived once per rendered frame, however many steps were taken
+		Resource normals = renderGraph->createTexture("normals",
+			{ normalTexWidth, normalTexHeight, GL_RG16F, GL_RG, GL_FLOAT, true });
+		renderGraph->addPass("Normals", { water }, { normals }, { 0, false }, [=]() {
+			GLState::useProgram(normalShader);
+			GLState::bindTexture(0, GL_TEXTURE_2D, renderGraph->texture(water));
+			GLState::bindVertexArray(vao);
+			glDrawElements(GL_TRIANGLES, vcount, GL_UNSIGNED_INT, NULL);
+		});
 
-		// Flip the camera
-		rot = glm::rotate(glm::mat4(1.0f), -glm::radians(camCoords.y), glm::vec3(1.0, 0.0, 0.0));
-		rot = glm::rotate(rot, glm::radians(camCoords.x), glm::vec3(0.0, 1.0, 0.0));
-		glm::mat4 xformRflect = proj * view * rot;
+		// Pass 1.1: Environment Mapping =============================
 
-		// Send transformation matrix to shader
-		glUniformMatrix4fv(uniXform, 1, GL_FALSE, value_ptr(xformRflect));
+		// The light, the terrain and the mesh placement rarely change,
+		// so the map is only re-rendered when one of them did
+		Resource envMap = renderGraph->importTexture("environment", environmentMap, texWidth, texHeight);
+		bool envMapValid = !envMapDirty && envMapXform == lightViewXform && envMapMeshOffset == meshOffset;
+		if (envMapValid)
+			envMapReuses++;
+		else renderGraph->addPass("Environment", {}, { envMap }, { GL_COLOR_BUFFER_BIT, false }, [=]() {
+			GLState::useProgram(envShader);
+			frameUniforms->bind(VIEW_CAMERA);
+
+			// Enable terrain texture
+			GLState::bindTexture(0, GL_TEXTURE_2D, islandsTexture);
+			// Draw the scene (double-sided walls and double-sided terrain)
+			GLState::disable(GL_CULL_FACE);
+			mesh->move(meshOffset.x, meshOffset.y, meshOffset.z);
+			drawMesh(MESH_PASS_ENVIRONMENT, envMeshLevel, uniEnvModel);
+			glUniformMatrix4fv(uniEnvModel, 1, GL_FALSE, value_ptr(glm::mat4(1.0f)));
+			std::vector<GeometryArena::Range> drawList = { wallRange };
+			if (enableTerrain)
+				drawList.push_back(terrRange);
+			sceneGeometry->draw(drawList);
+			GLState::enable(GL_CULL_FACE);
+
+			// Remember what the map was rendered with
+			envMapDirty = false;
+			envMapXform = lightViewXform;
+			envMapMeshOffset = meshOffset;
+			envMapRenders++;
+		});
 
-		// Clip water surface
-		glm::vec4 clipPlaneReflect(0.0f, 1.0f, 0.0f, 0.0f);
-		glUniform4fv(uniClipPlane, 1, value_ptr(clipPlaneReflect));
+		// Pass 1.2: Caustics Mapping =============================
 
-		// Clear the texture
-		glClear(GL_COLOR_BUFFER_BIT);
-		// Draw the scene (skybox, walls and double-sided clipped terrain above water surface)
-		glBindVertexArray(skyVao);
-		glDrawElements(GL_TRIANGLES, skyVcount, GL_UNSIGNED_INT, NULL);
-		glBindVertexArray(wallVao);
-		glDrawElements(GL_TRIANGLES, wallVcount, GL_UNSIGNED_INT, NULL);
-		if (enableTerrain) {
-			glDisable(GL_CULL_FACE);
-			glEnable(GL_CLIP_DISTANCE0);
-			glBindVertexArray(terrVao);
-			glDrawElements(GL_TRIANGLES, terrVcount, GL_UNSIGNED_INT, NULL);
-			glDisable(GL_CLIP_DISTANCE0);
-			glEnable(GL_CULL_FACE);
+		// The caustics change slowly compared to the frame rate, so with an interval above
+		// one the map is only re-rendered every few frames and blended into the previous one
+		// (hiding the steps between updates); a new environment map always forces an update
+		Resource causticsBlurred = renderGraph->importTexture("causticsBlurred", causticsMap, texWidth, texHeight);
+		bool causticsFresh = causticsAge < 0 || causticsInterval == 1 || !envMapValid;
+		if (causticsFresh || causticsAge + 1 >= causticsInterval) {
+			float weight = causticsFresh ? 1.0f : 1.0f - CAUSTICS_HISTORY;
+			causticsAge = 0;
+			causticsUpdates++;
+
+			Resource caustics = renderGraph->createTexture("caustics",
+				{ texWidth, texHeight, GL_RGBA8_SNORM, GL_RGBA, GL_BYTE, false });
+			renderGraph->addPass("Caustics", { water, normals, envMap }, { caustics }, CAUSTICS_PASS_STATE, [=]() {
+				GLState::useProgram(causticsShader);
+				frameUniforms->bind(VIEW_CAMERA);
+
+				// Enable terrain texture
+				GLState::bindTexture(0, GL_TEXTURE_2D, renderGraph->texture(water));
+				GLState::bindTexture(1, GL_TEXTURE_2D, renderGraph->texture(envMap));
+				GLState::bindTexture(2, GL_TEXTURE_2D, renderGraph->texture(normals));
+				// Draw the photon grid over the water surface
+				GLState::bindVertexArray(emptyVao);
+				glDrawArrays(GL_TRIANGLES, 0, causticsGrid * causticsGrid * 6);
+			});
+
+			// Pass 1.3: Caustics blur ===============================
+
+			// Separable Gaussian at caustics map resolution, so shading needs a single fetch.
+			// The half-texel tap steps and the factor 2 keep the radius and brightness of
+			// the horizontal plus vertical blurs previously summed per fragment.
+			Resource causticsBlurX = renderGraph->createTexture("causticsBlurX",
+				{ texWidth, texHeight, GL_RG16F, GL_RG, GL_FLOAT, false });
+			renderGraph->addPass("Caustics blur X", { caustics }, { causticsBlurX }, { 0, false }, [=]() {
+				GLState::useProgram(blurShader);
+				glUniform2f(uniBlurDirection, 0.5f, 0.0f);
+				glUniform1f(uniBlurScale, 1.0f);
+				glUniform1f(uniBlurWeight, 1.0f);
+				GLState::bindTexture(0, GL_TEXTURE_2D, renderGraph->texture(caustics));
+				GLState::bindVertexArray(vao);
+				glDrawElements(GL_TRIANGLES, vcount, GL_UNSIGNED_INT, NULL);
+			});
+			// The vertical pass blends into the persistent map
+			renderGraph->addPass("Caustics blur Y", { causticsBlurX }, { causticsBlurred }, { 0, weight < 1.0f }, [=]() {
+				GLState::useProgram(blurShader);
+				glUniform2f(uniBlurDirection, 0.0f, 0.5f);
+				glUniform1f(uniBlurScale, 2.0f);
+				glUniform1f(uniBlurWeight, weight);
+				GLState::bindTexture(0, GL_TEXTURE_2D, renderGraph->texture(causticsBlurX));
+				GLState::bindVertexArray(vao);
+				if (weight < 1.0f) {
+					// Only the intensity is blended; the depth of the shadow test must not lag behind
+					glColorMask(GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE);
+					glDrawElements(GL_TRIANGLES, vcount, GL_UNSIGNED_INT, NULL);
+					GLState::disable(GL_BLEND);
+					glColorMask(GL_FALSE, GL_TRUE, GL_FALSE, GL_FALSE);
+					glDrawElements(GL_TRIANGLES, vcount, GL_UNSIGNED_INT, NULL);
+					glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+				}
+				else glDrawElements(GL_TRIANGLES, vcount, GL_UNSIGNED_INT, NULL);
+			});
 		}
+		else {
+			causticsAge++;
+			causticsReuses++;
+		}
+
+		// Pass 2: Refraction ===============================
+
+		// Screen-space targets, sampled with normalized coordinates (so any size works).
+		// Under a frame budget they follow the window size, scaled to fit the budget.
+		GLsizei screenTexWidth = texWidth, screenTexHeight = texHeight;
+		if (resolution) {
+			screenTexWidth = std::max(GLsizei(width * resolution->scale() + 0.5f), 1);
+			screenTexHeight = std::max(GLsizei(height * resolution->scale() + 0.5f), 1);
+		}
+		Resource refraction = renderGraph->createTexture("refraction",
+			{ screenTexWidth, screenTexHeight, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, false });
+		renderGraph->addPass("Refraction", { causticsBlurred }, { refraction }, { GL_COLOR_BUFFER_BIT, true }, [=]() {
+			frameUniforms->bind(VIEW_CAMERA);
+
+			// Draw the textures
+			GLState::bindTexture(1, GL_TEXTURE_2D, islandsTexture);
+			GLState::bindTexture(2, GL_TEXTURE_2D, wallTexture);
+			GLState::bindTexture(3, GL_TEXTURE_2D, terrTexture);
+			GLState::bindTexture(6, GL_TEXTURE_CUBE_MAP, skyboxTexture);
+			GLState::bindTexture(7, GL_TEXTURE_2D, renderGraph->texture(causticsBlurred));
+			// Draw the scene (skybox, walls and terrain)
+			std::vector<SceneDraw> drawList = { { MAT_SKYBOX, skyRange }, { MAT_WALL, wallRange } };
+			if (enableTerrain)
+				drawList.push_back({ MAT_TERR, terrRange });
+			drawScene(drawList);
+		});
 
-		// Swap prev and curr textures
-		std::swap(prevTexture, currTexture);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, currTexture, 0);
+		// Pass 3: Reflection ===============================
+
+		Resource reflection = renderGraph->createTexture("reflection",
+			{ screenTexWidth, screenTexHeight, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, false });
+		renderGraph->addPass("Reflection", { causticsBlurred }, { reflection }, { GL_COLOR_BUFFER_BIT, true }, [=]() {
+			frameUniforms->bind(VIEW_REFLECTION);
+
+			// Draw the textures
+			GLState::bindTexture(1, GL_TEXTURE_2D, islandsTexture);
+			GLState::bindTexture(2, GL_TEXTURE_2D, wallTexture);
+			GLState::bindTexture(3, GL_TEXTURE_2D, terrTexture);
+			GLState::bindTexture(6, GL_TEXTURE_CUBE_MAP, skyboxTexture);
+			GLState::bindTexture(7, GL_TEXTURE_2D, renderGraph->texture(causticsBlurred));
+			// Draw the scene (skybox, walls and double-sided clipped terrain above water surface)
+			drawScene({ { MAT_SKYBOX, skyRange }, { MAT_WALL, wallRange } });
+			if (enableTerrain) {
+				GLState::disable(GL_CULL_FACE);
+				GLState::enable(GL_CLIP_DISTANCE0);
+				drawScene({ { MAT_TERR, terrRange } });
+				GLState::disable(GL_CLIP_DISTANCE0);
+				GLState::enable(GL_CULL_FACE);
+			}
+		});
 
 		// Pass 4: Display ===============================
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);		// Restore default framebuffer (draw to window)
-		glViewport(0, 0, width, height);			// Reshape to window size
-
-		// Send transformation matrix to shader
-		glUniformMatrix4fv(uniXform, 1, GL_FALSE, value_ptr(xform));
-		glUniformMatrix4fv(uniLightViewXform, 1, GL_FALSE, value_ptr(lightViewXform));
-
-		// Camera position for water fresnel calculation
-		glUniformMatrix4fv(uniCamPos, 1, GL_FALSE, value_ptr(camCoords));
-
-		glUniform3fv(uniLightDirDisp, 1, value_ptr(lightDir));
-
-		// Clear the window
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		// Draw the textures
-		glActiveTexture(GL_TEXTURE0 + 0);
-		glBindTexture(GL_TEXTURE_2D, prevTexture);
-		glActiveTexture(GL_TEXTURE0 + 4);
-		glBindTexture(GL_TEXTURE_2D, refractionTexture);
-		glActiveTexture(GL_TEXTURE0 + 5);
-		glBindTexture(GL_TEXTURE_2D, reflectionTexture);
-		// Draw the scene (walls, double-sided terrain and double-sided water)
-		mesh->move(0.0f, -0.5f, 0.0f);
-		mesh->draw();
-		glBindVertexArray(wallVao);
-		glDrawElements(GL_TRIANGLES, wallVcount, GL_UNSIGNED_INT, NULL);
-		glDisable(GL_CULL_FACE);
-		if (enableTerrain) {
-			glBindVertexArray(terrVao);
-			glDrawElements(GL_TRIANGLES, terrVcount, GL_UNSIGNED_INT, NULL);
+		Resource backbuffer = renderGraph->importBackbuffer(width, height, window->framebuffer());
+		std::vector<Resource> dispReads = { water, normals, causticsBlurred };
+		if (waterOnScreen) {
+			dispReads.push_back(refraction);
+			dispReads.push_back(reflection);
 		}
-		glBindVertexArray(waterVao);
-		glDrawElements(GL_TRIANGLES, waterVcount, GL_UNSIGNED_INT, NULL);
-		glEnable(GL_CULL_FACE);
+		renderGraph->addPass("Display", dispReads, { backbuffer }, { GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, true }, [=]() {
+			frameUniforms->bind(VIEW_CAMERA);
+
+			// Draw the textures
+			GLState::bindTexture(0, GL_TEXTURE_2D, renderGraph->texture(water));
+			GLState::bindTexture(1, GL_TEXTURE_2D, islandsTexture);
+			GLState::bindTexture(2, GL_TEXTURE_2D, wallTexture);
+			GLState::bindTexture(3, GL_TEXTURE_2D, terrTexture);
+			GLState::bindTexture(6, GL_TEXTURE_CUBE_MAP, skyboxTexture);
+			GLState::bindTexture(7, GL_TEXTURE_2D, renderGraph->texture(causticsBlurred));
+			GLState::bindTexture(8, GL_TEXTURE_2D, renderGraph->texture(normals));
+			// Draw the scene (walls, double-sided terrain and double-sided water)
+			mesh->move(meshOffset.x, meshOffset.y, meshOffset.z);
+			const DispProgram& meshDisp = useDispShader(0);
+			drawMesh(MESH_PASS_DISPLAY, dispMeshLevel, meshDisp.uniModel);
+			glUniformMatrix4fv(meshDisp.uniModel, 1, GL_FALSE, value_ptr(glm::mat4(1.0f)));
+			drawScene({ { MAT_WALL, wallRange } });
+			GLState::disable(GL_CULL_FACE);
+			std::vector<SceneDraw> drawList;
+			if (enableTerrain)
+				drawList.push_back({ MAT_TERR, terrRange });
+			if (waterOnScreen) {
+				GLState::bindTexture(4, GL_TEXTURE_2D, renderGraph->texture(refraction));
+				GLState::bindTexture(5, GL_TEXTURE_2D, renderGraph->texture(reflection));
+				if (!proceduralWater)
+					drawList.push_back({ MAT_WATER, waterRange });
+			}
+			drawScene(drawList);
+			if (waterOnScreen && proceduralWater) {
+				const DispProgram& bodyDisp = useDispShader(MAT_WATER);
+				glUniform1i(bodyDisp.uniVertexSource, VERTEX_WATER_BODY);
+				GLState::bindVertexArray(emptyVao);
+				glDrawArrays(GL_TRIANGLES, 0, waterBodyVcount);
+				glUniform1i(bodyDisp.uniVertexSource, VERTEX_ATTRIBUTES);
+			}
+			if (waterOnScreen) {
+				const DispProgram& surfDisp = useDispShader(MAT_WATER_SURF);
+				if (proceduralWater) glUniform1i(surfDisp.uniVertexSource, VERTEX_PATCH);
+				waterSurface->draw(waterPatches);
+				if (proceduralWater) glUniform1i(surfDisp.uniVertexSource, VERTEX_ATTRIBUTES);
+			}
+			GLState::enable(GL_CULL_FACE);
+		});
 
 		/*/ DEBUG PASS =============================
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glViewport(0, 0, width, height);
-		glUseProgram(debugShader);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glActiveTexture(GL_TEXTURE0 + 0);
-		glBindTexture(GL_TEXTURE_2D, environmentMap);
-		glBindVertexArray(vao);
-		glDrawElements(GL_TRIANGLES, vcount, GL_UNSIGNED_INT, NULL);
-		glBindVertexArray(0);*/
-
-		// Revert state
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glBindVertexArray(0);
-		glUseProgram(0);
+		renderGraph->addPass("Debug", { envMap }, { backbuffer }, { GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, false }, [=]() {
+			GLState::useProgram(debugShader);
+			GLState::bindTexture(0, GL_TEXTURE_2D, renderGraph->texture(envMap));
+			GLState::bindVertexArray(vao);
+			glDrawElements(GL_TRIANGLES, vcount, GL_UNSIGNED_INT, NULL);
+		});*/
+
+		renderGraph->execute();
+		renderedFrames++;
+		if (benchmarkCaustics) {
+			benchmarkCausticsGrids(renderGraph->texture(water), renderGraph->texture(normals));
+			benchmarkCaustics = false;
+		}
+		frameUniforms->endFrame();
+		if (gpuProfiler) {
+			gpuProfiler->endFrame();
+			meshLevelFrame++;
+			collectMeshLevelTimes();
+		}
+		if (resolution)
+			resolution->update(gpuProfiler->lastFrameMs(),
+				gpuProfiler->lastMs("Refraction") + gpuProfiler->lastMs("Reflection"));
+		if (frameCapture) {
+			CPU_TRACE_SCOPE("Frame capture");
+			frameCapture->capture(window->framebuffer(), width, height);
+		}
+		if (profileOverlay)
+			drawProfilerOverlay();
 
 		// Display the back buffer
-		glutSwapBuffers();
+		{
+			CPU_TRACE_SCOPE("swapBuffers");
+			window->swapBuffers();
+		}
+		GLState::endFrame();
+
+		if (benchmark) {
+			// Time from the end of the previous frame to the end of this one
+			uint64_t frameEnd = CpuTrace::now();
+			benchmark->endFrame(window->frameCount() - 1, (frameEnd - benchmarkFrameEnd) * 1e-6, gpuProfiler.get());
+			benchmarkFrameEnd = frameEnd;
+			if (window->frameCount() >= benchmark->framesToRender(gpuProfiler.get()))
+				window->requestExit();
+		}
 
 	} catch (const std::exception& e) {
 		std::cerr << "Fatal error: " << e.what() << std::endl;
-		glutLeaveMainLoop();
+		window->requestExit();
+	}
+}
+
+// Move the camera along the scenario's orbit and apply the events of a frame
+void playBenchmark(unsigned frame) {
+	camCoords += camOrbit;
+	std::vector<Benchmark::Event> events = benchmark->events(frame);
+	for (auto e = events.begin(); e != events.end(); ++e) {
+		switch (e->type) {
+		case Benchmark::EVENT_CAMERA:
+			camCoords = e->value;
+			break;
+		case Benchmark::EVENT_ORBIT:
+			camOrbit = e->value;
+			break;
+		case Benchmark::EVENT_IMPULSE:
+			mousePos = glm::vec2(e->value);
+			break;
+		case Benchmark::EVENT_RELEASE:
+			mousePos = glm::vec2(-2.0f, -2.0f);
+			break;
+		case Benchmark::EVENT_TERRAIN:
+			if (enableTerrain != (e->value.x != 0.0f))
+				menu(MENU_TERR);
+			break;
+		case Benchmark::EVENT_RESEED:
+			menu(MENU_RESEED);
+			break;
+		}
 	}
+
+	// Same limits as the mouse controls
+	while (camCoords.x > 180.0f) camCoords.x -= 360.0f;
+	while (camCoords.x < -180.0f) camCoords.x += 360.0f;
+	camCoords.y = glm::clamp(camCoords.y, -90.0f, 90.0f);
+	camCoords.z = glm::clamp(camCoords.z, 0.1f, 10.0f);
 }
 
 void reshape(GLint width, GLint height) {
 	::width = width;
 	::height = height;
-	glViewport(0, 0, width, height);
+	GLState::viewport(width, height);
 }
 
 void keyRelease(unsigned char key, int x, int y) {
@@ -1163,6 +1808,21 @@ void keyRelease(unsigned char key, int x, int y) {
 	case 27:	// Escape key
 		menu(MENU_EXIT);
 		break;
+	case 't':	// Write the CPU trace captured so far
+	case 'T':
+		if (!traceFile.empty())
+			writeTrace();
+		break;
+	}
+}
+
+// Write the CPU zones recorded so far to the trace file
+void writeTrace() {
+	try {
+		CpuTrace::writeJson(traceFile);
+		std::cout << "CPU trace written to " << traceFile << std::endl;
+	} catch (const std::exception& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
 	}
 }
 
@@ -1197,7 +1857,7 @@ glm::ivec2 mouseToTexCoord(int x, int y) {
 }
 
 void mouseBtn(int button, int state, int x, int y) {
-	if (button == GLUT_LEFT && state == GLUT_DOWN) {
+	if (button == Window::BUTTON_LEFT && state == Window::BUTTON_DOWN) {
 		glm::ivec2 iPos = mouseToTexCoord(x, y);
 		mousePos.x = (float)iPos.x / (float)texWidth;
 		mousePos.y = (float)iPos.y / (float)texWidth;
@@ -1207,7 +1867,7 @@ void mouseBtn(int button, int state, int x, int y) {
 		camOrigin = glm::vec2(camCoords);
 		mouseOrigin = glm::vec2(x, y);
 	}
-	if (button == GLUT_LEFT && state == GLUT_UP) {
+	if (button == Window::BUTTON_LEFT && state == Window::BUTTON_UP) {
 		mousePos.x = -2.0f;
 		mousePos.y = -2.0f;
 
@@ -1241,13 +1901,16 @@ void mouseMove(int x, int y) {
 }
 
 void idle() {
-	glutPostRedisplay();
+	window->postRedisplay();
+	// Benchmarks run as fast as possible
+	if (benchmark) return;
+
 	// I've tested the program on different devices.
 	// Some devices run the program slow and have almost no water motions.
 	// The GPGPU calculation of wave equation is heavily depend on frames per second.
 	// To solve this problem I have to manually slow down the rendering a little bit
 	// to unify the performance on different devices.
-	Sleep(10);
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
 
 	// P.S: I've got this program run on my ancient Macbook with CoreDuo intergrated GPU,
 	// and there was compeletely no mouse interaction or any kind of water motions,
@@ -1257,10 +1920,46 @@ void idle() {
 	// Very strange effects on different devices which I have completely no idea why.
 }
 
+// Window input passes through the journal: it is recorded, or ignored while a
+// recording is replayed, except the Escape key, which aborts the replay
+void input(const InputJournal::Event& event) {
+	if (journal) {
+		if (journal->replaying()) {
+			if (event.type == InputJournal::EVENT_KEY && event.args[0] == 27)
+				window->requestExit();
+			return;
+		}
+		journal->record(simStep, event);
+	}
+	dispatchInput(event);
+}
+
+// Hand an input event to its callback
+void dispatchInput(const InputJournal::Event& event) {
+	const int* a = event.args;
+	switch (event.type) {
+	case InputJournal::EVENT_RESHAPE:
+		reshape(a[0], a[1]);
+		break;
+	case InputJournal::EVENT_KEY:
+		keyRelease((unsigned char)a[0], a[1], a[2]);
+		break;
+	case InputJournal::EVENT_MOUSE_BUTTON:
+		mouseBtn(a[0], a[1], a[2], a[3]);
+		break;
+	case InputJournal::EVENT_MOUSE_MOVE:
+		mouseMove(a[0], a[1]);
+		break;
+	case InputJournal::EVENT_MENU:
+		menu(a[0]);
+		break;
+	}
+}
+
 void menu(int cmd) {
 	switch (cmd) {
 	case MENU_EXIT:
-		glutLeaveMainLoop();
+		window->requestExit();
 		break;
 
 	case MENU_TERR:
@@ -1281,68 +1980,148 @@ void cleanup() {
 	if (islandsTexture) { glDeleteTextures(1, &islandsTexture); islandsTexture = 0; }
 	if (wallTexture) { glDeleteTextures(1, &wallTexture); wallTexture = 0; }
 	if (terrTexture) { glDeleteTextures(1, &terrTexture); terrTexture = 0; }
-	if (refractionTexture) { glDeleteTextures(1, &refractionTexture); refractionTexture = 0; }
-	if (reflectionTexture) { glDeleteTextures(1, &reflectionTexture); reflectionTexture = 0; }
 	if (skyboxTexture) { glDeleteTextures(1, &skyboxTexture); skyboxTexture = 0; }
+	if (environmentMap) { glDeleteTextures(1, &environmentMap); environmentMap = 0; }
+	if (causticsMap) { glDeleteTextures(1, &causticsMap); causticsMap = 0; }
 
-	if (dispShader) { glDeleteProgram(dispShader); dispShader = 0; }
+	releaseDispShader(dispShader);
+	for (auto d = dispMaterialShaders.begin(); d != dispMaterialShaders.end(); ++d)
+		releaseDispShader(*d);
+	dispMaterialShaders.clear();
 	if (gpgpuShader) { glDeleteProgram(gpgpuShader); gpgpuShader = 0; }
+	if (normalShader) { glDeleteProgram(normalShader); normalShader = 0; }
+	if (blurShader) { glDeleteProgram(blurShader); blurShader = 0; }
 	if (envShader) { glDeleteProgram(envShader); envShader = 0; }
 	if (causticsShader) { glDeleteProgram(causticsShader); causticsShader = 0; }
 	if (debugShader) { glDeleteProgram(debugShader); debugShader = 0; }
 
-	uniXform = 0;
-	uniClipPlane = 0;
+	uniEnvModel = 0;
 	uniMousePos = 0;
-	uniCamPos = 0;
-	uniEnvXform = 0;
-	uniCausticsXform = 0;
-	uniLightDir = 0;
-	uniLightViewXform = 0;
-	uniLightDirDisp = 0;
+	uniBlurDirection = 0;
+	uniBlurScale = 0;
+	uniBlurWeight = 0;
+	uniPhotonGrid = 0;
 
 	if (vao) { glDeleteVertexArrays(1, &vao); vao = 0; }
 	if (vbuf) { glDeleteBuffers(1, &vbuf); vbuf = 0; }
 	if (ibuf) { glDeleteBuffers(1, &ibuf); ibuf = 0; }
 	vcount = 0;
-	if (fbo) { glDeleteFramebuffers(1, &fbo); fbo = 0; }
-
-	if (waterVao) { glDeleteVertexArrays(1, &waterVao); waterVao = 0; }
-	if (waterVbuf) { glDeleteBuffers(1, &waterVbuf); waterVbuf = 0; }
-	if (waterIbuf) { glDeleteBuffers(1, &waterIbuf); waterIbuf = 0; }
-	waterVcount = 0;
-
-	if (waterSurfVao) { glDeleteVertexArrays(1, &waterSurfVao); waterSurfVao = 0; }
-	if (waterSurfVbuf) { glDeleteBuffers(1, &waterSurfVbuf); waterSurfVbuf = 0; }
-	if (waterSurfIbuf) { glDeleteBuffers(1, &waterSurfIbuf); waterSurfIbuf = 0; }
-	waterSurfVcount = 0;
-
-	if (wallVao) { glDeleteVertexArrays(1, &wallVao); wallVao = 0; }
-	if (wallVbuf) { glDeleteBuffers(1, &wallVbuf); wallVbuf = 0; }
-	if (wallIbuf) { glDeleteBuffers(1, &wallIbuf); wallIbuf = 0; }
-	wallVcount = 0;
-
-	if (skyVao) { glDeleteVertexArrays(1, &skyVao); skyVao = 0; }
-	if (skyVbuf) { glDeleteBuffers(1, &skyVbuf); skyVbuf = 0; }
-	if (skyIbuf) { glDeleteBuffers(1, &skyIbuf); skyIbuf = 0; }
-	skyVcount = 0;
-
-	if (terrVao) { glDeleteVertexArrays(1, &terrVao); terrVao = 0; }
-	if (terrVbuf) { glDeleteBuffers(1, &terrVbuf); terrVbuf = 0; }
-	if (terrIbuf) { glDeleteBuffers(1, &terrIbuf); terrIbuf = 0; }
-	terrVcount = 0;
+	if (renderGraph) { renderGraph = NULL; }
+	if (benchmark) {
+		benchmark->report(std::cout, simSteps);
+		if (!benchmarkJson.empty()) {
+			try {
+				benchmark->writeJson(benchmarkJson, simSteps);
+				std::cout << "Benchmark summary written to " << benchmarkJson << std::endl;
+			} catch (const std::exception& e) {
+				std::cerr << "Error: " << e.what() << std::endl;
+			}
+		}
+		benchmark = NULL;
+		benchmarkJson = "";
+	}
+	if (gpuProfiler) {
+		if (timePasses) {
+			std::cout << "GPU time per frame:" << std::endl;
+			gpuProfiler->report(std::cout);
+		}
+		gpuProfiler = NULL;
+	}
+	if (frameCapture) {
+		frameCapture->finish();
+		frameCapture->report(std::cout);
+		frameCapture = NULL;
+	}
+	if (resolution) {
+		std::cout << "Dynamic resolution: refraction and reflection at " << resolution->scale() * 100.0f
+			<< "% of the window after " << resolution->changes() << " changes (budget "
+			<< resolution->budget() << " ms)" << std::endl;
+		resolution = NULL;
+	}
+	if (frameUniforms) { frameUniforms = NULL; }
+
+	if (sceneGeometry) { sceneGeometry = NULL; }
+	if (emptyVao) { GLState::forgetVertexArray(emptyVao); glDeleteVertexArrays(1, &emptyVao); emptyVao = 0; }
+	if (waterSurface) {
+		if (renderedFrames > 0)
+			std::cout << "Water surface: " << (waterSurface->drawnTriangles() - benchmarkTriangles) / renderedFrames
+				<< " triangles per frame (full grid: " << waterSurface->fullGridTriangles() << ")" << std::endl;
+		waterSurface = NULL;
+	}
+	if (renderedFrames > 0) {
+		// RG16F texels with their mip chain, against deriving them after every step at full size
+		double derived = normalTexWidth * normalTexHeight * 4.0 * 4.0 / 3.0 / (1 << 20);
+		double perStep = simSteps * texWidth * texHeight * 4.0 * 4.0 / 3.0 / (1 << 20);
+		std::cout << "Water normals: " << normalTexWidth << "x" << normalTexHeight << " once per frame of " << simSteps
+			<< " wave steps, " << derived << " MB written per frame (" << perStep << " MB if derived every step at "
+			<< texWidth << "x" << texHeight << ")" << std::endl;
+	}
 
 	if (wallTexData) { stbi_image_free(wallTexData); wallTexData = NULL; }
 
-	if (mesh) { mesh = NULL; }
+	if (mesh) {
+		std::cout << "Mesh: loaded in " << mesh->loadMs() << " ms ("
+			<< (mesh->loadedFromCache() ? "binary cache" : "parsed") << ")" << std::endl;
+		// Memory of the indexed buffers against one vertex per triangle corner
+		const Mesh::Stats& stats = mesh->stats();
+		size_t unindexedBytes = stats.triangles * 3 * sizeof(Mesh::Vtx);
+		size_t indexedBytes = stats.vertices * sizeof(Mesh::Vtx) + stats.triangles * 3 * sizeof(GLuint);
+		std::cout << "Mesh: " << stats.triangles << " triangles, " << stats.vertices << " vertices (" << stats.triangles * 3
+			<< " unindexed), ACMR " << stats.acmrFileOrder << " in file order, " << stats.acmrOptimized << " optimized, "
+			<< indexedBytes / 1024 << " KB of buffers (" << unindexedBytes / 1024 << " KB unindexed, "
+			<< (unindexedBytes > indexedBytes ? (unindexedBytes - indexedBytes) / 1024 : 0) << " KB saved)" << std::endl;
+		for (int i = 0; i < mesh->levelCount(); i++) {
+			const Mesh::Level& level = mesh->level(i);
+			std::cout << "Mesh level " << i << ": " << level.triangles << " triangles, error " << level.error;
+			for (int pass = 0; pass < MESH_PASS_COUNT; pass++) {
+				MeshLevelUse use = size_t(i) < meshLevelUse[pass].size() ? meshLevelUse[pass][i] : MeshLevelUse();
+				std::cout << ", " << meshPassNames[pass] << " " << use.frames << " frames";
+				if (use.timedFrames > 0)
+					std::cout << " (" << use.gpuMs / use.timedFrames << " ms per pass)";
+			}
+			std::cout << std::endl;
+		}
+		mesh = NULL;
+	}
+
+	if (renderedFrames > 0) {
+		GLState::Counters calls = GLState::totalCounters();
+		std::cout << "GL state calls per frame: " << calls.issued / renderedFrames << " issued, "
+			<< calls.elided / renderedFrames << " elided" << std::endl;
+		renderedFrames = 0;
+	}
+	if (envMapRenders + envMapReuses > 0) {
+		std::cout << "Environment map: rendered " << envMapRenders << " times, reused in "
+			<< envMapReuses << " of " << envMapRenders + envMapReuses << " frames" << std::endl;
+		envMapRenders = 0;
+		envMapReuses = 0;
+	}
+	if (causticsUpdates + causticsReuses > 0) {
+		std::cout << "Caustics map: rendered " << causticsUpdates << " times, reused in "
+			<< causticsReuses << " of " << causticsUpdates + causticsReuses << " frames" << std::endl;
+		causticsUpdates = 0;
+		causticsReuses = 0;
+	}
+	if (journal) {
+		if (!journal->replaying())
+			journal->finish(simStep);
+		journal->report(std::cout);
+		journal = NULL;
+	}
+	if (!traceFile.empty()) {
+		writeTrace();
+		CpuTrace::enable(false);
+		traceFile = "";
+	}
 }
 
 void generateIslands() {
+	CPU_TRACE_SCOPE("generateIslands");
 	perlin.reseed(noise(rng));
 
 	islandsTexData.clear();
 	islandsTexData.resize(texWidth * texHeight, glm::u8vec3(255, 255, 255));
-	if (islandsTexture) { glDeleteTextures(1, &islandsTexture); islandsTexture = 0; }
+	if (islandsTexture) { GLState::forgetTexture(islandsTexture); glDeleteTextures(1, &islandsTexture); islandsTexture = 0; }
 
 	if (enableTerrain) {	// Perlin noise generation
 		for (int j = 0; j < texHeight; j++) {
@@ -1356,13 +2135,34 @@ void generateIslands() {
 	}
 
 	glGenTextures(1, &islandsTexture);
-	glBindTexture(GL_TEXTURE_2D, islandsTexture);
+	GLState::bindTexture(0, GL_TEXTURE_2D, islandsTexture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texWidth, texHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, islandsTexData.data());
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// The terrain is part of the environment map
+	envMapDirty = true;
+}
+
+// Whether any part of a world-space box may be inside the view frustum
+bool boxOnScreen(const glm::mat4& xform, glm::vec3 minBB, glm::vec3 maxBB) {
+	// The box is invisible if all its corners are outside the same clip plane
+	int outside[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int i = 0; i < 8; i++) {
+		glm::vec4 corner((i & 1) ? maxBB.x : minBB.x, (i & 2) ? maxBB.y : minBB.y, (i & 4) ? maxBB.z : minBB.z, 1.0f);
+		glm::vec4 clip = xform * corner;
+		if (clip.x < -clip.w) outside[0]++;
+		if (clip.x > clip.w) outside[1]++;
+		if (clip.y < -clip.w) outside[2]++;
+		if (clip.y > clip.w) outside[3]++;
+		if (clip.z < -clip.w) outside[4]++;
+		if (clip.z > clip.w) outside[5]++;
+	}
+	for (int p = 0; p < 6; p++)
+		if (outside[p] == 8) return false;
+	return true;
 }
 
 GLuint loadSkybox(std::vector<std::string> faces) {
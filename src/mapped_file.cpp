@@ -0,0 +1,62 @@
+#include "mapped_file.hpp"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) : data(NULL), size(0) {
+#ifdef _WIN32
+	mapping = NULL;
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("MappedFile::MappedFile() - Could not open file " + path);
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+		size = size_t(fileSize.QuadPart);
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		throw std::runtime_error("MappedFile::MappedFile() - Could not open file " + path);
+	struct stat info;
+	if (fstat(file, &info) == 0 && info.st_size > 0) {
+		size = size_t(info.st_size);
+		void* view = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (view != MAP_FAILED) {
+			madvise(view, size, MADV_SEQUENTIAL);
+			data = (const char*)view;
+		}
+	}
+#endif
+	if (size > 0 && !data) {
+		release();
+		throw std::runtime_error("MappedFile::MappedFile() - Could not map file " + path);
+	}
+}
+
+// Release resources
+void MappedFile::release() {
+#ifdef _WIN32
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (data) munmap((void*)data, size);
+	if (file >= 0) close(file);
+	file = -1;
+#endif
+	data = NULL;
+	size = 0;
+}
@@ -1,15 +1,72 @@
 #include "mesh.hpp"
+#include "gl_state.hpp"
+#include "cpu_trace.hpp"
+#include "obj_loader.hpp"
+#include "mapped_file.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include <glm/gtc/type_ptr.hpp>
 #include <fstream>
 #include <iostream>
-#include <sstream>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <unordered_map>
+#include <thread>
+
+namespace {
+	const char CACHE_MAGIC[8] = { 'G', 'L', 'W', 'M', 'E', 'S', 'H', 0 };
+	const uint32_t CACHE_VERSION = 3;
+	// Sections start on page boundaries, so their mapped pages go to glBufferData as they are
+	const uint64_t CACHE_ALIGNMENT = 4096;
+	// Levels of detail are not simplified below this many triangles
+	const size_t MIN_LEVEL_TRIANGLES = 64;
+
+	struct CacheLevel {
+		uint64_t firstIndex;
+		uint64_t triangles;
+		float error;
+		uint32_t reserved;
+	};
+
+	// Cache file header, followed by the sections
+	struct CacheHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t vertexStride;		// sizeof(Mesh::Vtx)
+		uint64_t sourceSize;		// Source file the cache was built from
+		int64_t sourceTime;			// Its modification time (file clock ticks)
+		uint64_t sourceHash;		// FNV-1a of its contents
+		float minBB[3];
+		float maxBB[3];
+		uint64_t vertexCount;		// Interleaved vertex buffer
+		uint64_t vertexOffset;
+		uint64_t indexCount;		// 32-bit index buffer, all levels of detail
+		uint64_t indexOffset;
+		float acmrFileOrder;		// Mesh::Stats of the buffers
+		float acmrOptimized;
+		uint32_t levelCount;
+		uint32_t reserved;
+		CacheLevel levels[Mesh::MAX_LEVELS];
+	};
+
+	uint64_t alignCache(uint64_t offset) {
+		return (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+	}
 
-// Helper functions
-int indexOfNumberLetter(std::string& str, int offset);
-int lastIndexOfNumberLetter(std::string& str);
-std::vector<std::string> split(const std::string& s, char delim);
+	// FNV-1a of a file's contents
+	uint64_t hashFile(const std::string& path) {
+		MappedFile file(path);
+		uint64_t hash = 14695981039346656037ULL;
+		for (const char* p = file.begin(); p != file.end(); p++)
+			hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+		return hash;
+	}
+}
 
 // Constructor - load mesh from file
-Mesh::Mesh(std::string filename) {
+Mesh::Mesh(std::string filename, bool useCache) : useCache(useCache) {
 	minBB = glm::vec3(std::numeric_limits<float>::max());
 	maxBB = glm::vec3(std::numeric_limits<float>::lowest());
 
@@ -20,255 +77,355 @@ Mesh::Mesh(std::string filename) {
 	currentRotation.y = 0.0f;
 	currentRotation.z = 0.0f;
 
+	transformedDirty = false;
+
 	vao = 0;
 	vbuf = 0;
-	vcount = 0;
+	ibuf = 0;
+	icount = 0;
+	meshStats = Stats();
+	fromCache = false;
+	loadTime = 0.0;
 	load(filename);
 }
 
 // Draw the mesh
-void Mesh::draw() {
-	glBindVertexArray(vao);
-	glDrawArrays(GL_TRIANGLES, 0, vcount);
-	glBindVertexArray(0);
+void Mesh::draw(GLint uniModel, int level) {
+	if (uniModel != -1)
+		glUniformMatrix4fv(uniModel, 1, GL_FALSE, value_ptr(modelMatrix()));
+	if (levels.empty()) return;
+	const Level& l = levels[std::min(std::max(level, 0), int(levels.size()) - 1)];
+	GLState::bindVertexArray(vao);
+	glDrawElements(GL_TRIANGLES, GLsizei(3 * l.triangles), GL_UNSIGNED_INT, (GLvoid*)(l.firstIndex * sizeof(GLuint)));
+}
+
+int Mesh::selectLevel(float pixelsPerUnit, float maxPixelError) const {
+	int selected = 0;
+	for (int i = 1; i < int(levels.size()); i++)
+		if (levels[i].error * pixelsPerUnit <= maxPixelError)
+			selected = i;
+	return selected;
 }
 
-// Load a wavefront OBJ file
+// Load a wavefront OBJ file, or its GPU buffers from the binary cache
 void Mesh::load(std::string filename) {
+	CPU_TRACE_SCOPE("Mesh::load");
+	auto start = std::chrono::steady_clock::now();
 	// Release resources
 	release();
-
-	std::ifstream file(filename);
-	if (!file.is_open()) {
-		std::stringstream ss;
-		ss << "Mesh::load() - Could not open file " << filename;
-		throw std::runtime_error(ss.str());
+	source = filename;
+
+	std::error_code error;
+	SourceStamp stamp;
+	stamp.size = std::filesystem::file_size(filename, error);
+	if (error)
+		throw std::runtime_error("Mesh::load() - Could not open file " + filename);
+	stamp.time = int64_t(std::filesystem::last_write_time(filename, error).time_since_epoch().count());
+
+	std::string cachePath = filename + ".cache";
+	fromCache = useCache && loadCache(cachePath, stamp);
+	if (!fromCache) {
+		loadSource();
+
+		std::vector<Vtx> vertices;
+		std::vector<unsigned int> indices;
+		buildIndexed(vertices, indices);
+		buildLevels(vertices, indices);
+		upload(vertices.data(), vertices.size(), indices.data(), indices.size());
+		if (useCache)
+			writeCache(cachePath, stamp, vertices, indices);
 	}
 
-	// Store vertex and normal data while reading
-	//std::vector<glm::vec3> raw_vertices;
-	//std::vector<glm::vec3> raw_normals;
-	//std::vector<unsigned int> v_elements;
-	//std::vector<unsigned int> n_elements;
-	raw_vertices.clear();
-	raw_normals.clear();
-	m_vertices.clear();
-	m_normals.clear();
-	v_elements.clear();
-	n_elements.clear();
+	loadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-	std::string line;
-	while (getline(file, line)) {
-		if (line.substr(0, 2) == "v ") {
-			// Read position data
-			int index1 = indexOfNumberLetter(line, 2);
-			int index2 = lastIndexOfNumberLetter(line);
-			std::vector<std::string> values = split(line.substr(index1, index2 - index1 + 1), ' ');
-			glm::vec3 vert(stof(values[0]), stof(values[1]), stof(values[2]));
-			raw_vertices.push_back(vert);
-
-			// Update bounding box
-			minBB = glm::min(minBB, vert);
-			maxBB = glm::max(maxBB, vert);
-		}
-		else if (line.substr(0, 3) == "vn ") {
-			// Read normal data
-			int index1 = indexOfNumberLetter(line, 2);
-			int index2 = lastIndexOfNumberLetter(line);
-			std::vector<std::string> values = split(line.substr(index1, index2 - index1 + 1), ' ');
-			raw_normals.push_back(glm::vec3(stof(values[0]), stof(values[1]), stof(values[2])));
+void Mesh::loadSource() {
+	ObjGeometry obj = loadObj(source);
+	raw_vertices = std::move(obj.positions);
+	raw_normals = std::move(obj.normals);
+	v_elements = std::move(obj.positionIndices);
+	n_elements = std::move(obj.normalIndices);
+	minBB = obj.minBB;
+	maxBB = obj.maxBB;
 
+	// Geometry is uploaded once, transformations are applied by the shaders
+	m_vertices = raw_vertices;
+	m_normals = raw_normals;
+	transformedDirty = true;
+}
+
+// Each (position, normal) pair of the faces becomes one vertex, then the
+// triangles are reordered for the post-transform cache and the vertices for fetching
+void Mesh::buildIndexed(std::vector<Vtx>& vertices, std::vector<unsigned int>& indices) {
+	CPU_TRACE_SCOPE("Mesh::buildIndexed");
+	bool hasNormals = n_elements.size() > 0;
+
+	// Without normals in the file, every position gets the area-weighted normal of its faces
+	std::vector<glm::vec3> smoothNormals;
+	if (!hasNormals) {
+		smoothNormals.assign(raw_vertices.size(), glm::vec3(0.0f));
+		for (size_t i = 0; i < v_elements.size(); i += 3) {
+			const glm::vec3& a = raw_vertices[v_elements[i + 0]];
+			glm::vec3 normal = cross(raw_vertices[v_elements[i + 1]] - a, raw_vertices[v_elements[i + 2]] - a);
+			for (int c = 0; c < 3; c++)
+				smoothNormals[v_elements[i + c]] += normal;
 		}
-		else if (line.substr(0, 2) == "f ") {
-			// Read face data
-			int index1 = indexOfNumberLetter(line, 2);
-			int index2 = lastIndexOfNumberLetter(line);
-			std::vector<std::string> values = split(line.substr(index1, index2 - index1 + 1), ' ');
-			for (int i = 0; i < values.size() - 2; i++) {
-				// Split up vertex indices
-				std::vector<std::string> v1 = split(values[0], '/');		// Triangle fan for ngons
-				std::vector<std::string> v2 = split(values[i + 1], '/');
-				std::vector<std::string> v3 = split(values[i + 2], '/');
-
-				// Store position indices
-				v_elements.push_back(stoul(v1[0]) - 1);
-				v_elements.push_back(stoul(v2[0]) - 1);
-				v_elements.push_back(stoul(v3[0]) - 1);
-
-				// Check for normals
-				if (v1.size() >= 3 && v1[2].length() > 0) {
-					n_elements.push_back(stoul(v1[2]) - 1);
-					n_elements.push_back(stoul(v2[2]) - 1);
-					n_elements.push_back(stoul(v3[2]) - 1);
-				}
-			}
+		for (auto n = smoothNormals.begin(); n != smoothNormals.end(); ++n) {
+			float length = glm::length(*n);
+			*n = length > 0.0f ? *n / length : glm::vec3(0.0f, 1.0f, 0.0f);
 		}
 	}
-	file.close();
-
-	// Create vertex array
-	std::vector<Vtx> vertices(v_elements.size());
-	for (int i = 0; i < v_elements.size(); i += 3) {
-		// Store positions
-		vertices[i + 0].pos = raw_vertices[v_elements[i + 0]];
-		vertices[i + 1].pos = raw_vertices[v_elements[i + 1]];
-		vertices[i + 2].pos = raw_vertices[v_elements[i + 2]];
-
-		// Check for normals
-		if (n_elements.size() > 0) {
-			// Store normals
-			vertices[i + 0].norm = raw_normals[n_elements[i + 0]];
-			vertices[i + 1].norm = raw_normals[n_elements[i + 1]];
-			vertices[i + 2].norm = raw_normals[n_elements[i + 2]];
+
+	std::unordered_map<uint64_t, unsigned int> unique;
+	unique.reserve(raw_vertices.size());
+	vertices.clear();
+	vertices.reserve(raw_vertices.size());
+	indices.resize(v_elements.size());
+	for (size_t i = 0; i < v_elements.size(); i++) {
+		unsigned int v = v_elements[i];
+		uint64_t key = hasNormals ? (uint64_t(v) << 32) | n_elements[i] : v;
+		auto inserted = unique.emplace(key, unsigned(vertices.size()));
+		if (inserted.second) {
+			Vtx vertex;
+			vertex.pos = raw_vertices[v];
+			vertex.norm = hasNormals ? raw_normals[n_elements[i]] : smoothNormals[v];
+			vertices.push_back(vertex);
 		}
-		else {
-			// Calculate normal
-			glm::vec3 normal = normalize(cross(vertices[i + 1].pos - vertices[i + 0].pos,
-				vertices[i + 2].pos - vertices[i + 0].pos));
-			vertices[i + 0].norm = normal;
-			vertices[i + 1].norm = normal;
-			vertices[i + 2].norm = normal;
+		indices[i] = inserted.first->second;
+	}
+
+	meshStats.triangles = indices.size() / 3;
+	meshStats.vertices = vertices.size();
+	meshStats.acmrFileOrder = averageCacheMissRatio(indices, vertices.size());
+	optimizeVertexCache(indices, vertices.size());
+	std::vector<unsigned int> remap = optimizeVertexFetch(indices, vertices.size());
+	std::vector<Vtx> ordered(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++)
+		ordered[remap[v]] = vertices[v];
+	vertices.swap(ordered);
+	meshStats.acmrOptimized = averageCacheMissRatio(indices, vertices.size());
+}
+
+// Every level is simplified from the full mesh on its own thread, so they
+// all take about as long as the largest one. The levels share the vertex buffer.
+void Mesh::buildLevels(const std::vector<Vtx>& vertices, std::vector<unsigned int>& indices) {
+	CPU_TRACE_SCOPE("Mesh::buildLevels");
+	levels.clear();
+	levels.push_back({ 0, indices.size() / 3, 0.0f });
+
+	std::vector<glm::vec3> positions(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++)
+		positions[v] = vertices[v].pos;
+
+	struct Simplified {
+		size_t target;
+		std::vector<unsigned int> indices;
+		float error;
+		std::string failure;		// Exception thrown by the simplifying thread
+	};
+	std::vector<Simplified> simplified;
+	for (int i = 1; i < MAX_LEVELS && (levels[0].triangles >> i) >= MIN_LEVEL_TRIANGLES; i++)
+		simplified.push_back({ levels[0].triangles >> i, {}, 0.0f, "" });
+	auto simplify = [&](Simplified& level) {
+		try {
+			CPU_TRACE_SCOPE("Mesh::simplify");
+			level.indices = simplifyMesh(positions, indices, level.target, level.error);
+			optimizeVertexCache(level.indices, positions.size());
+		} catch (const std::exception& e) {
+			level.failure = e.what();
 		}
+	};
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < simplified.size(); i++)
+		workers.push_back(std::thread(simplify, std::ref(simplified[i])));
+	for (auto w = workers.begin(); w != workers.end(); ++w)
+		w->join();
+
+	for (auto level = simplified.begin(); level != simplified.end(); ++level) {
+		if (!level->failure.empty())
+			throw std::runtime_error("Mesh::buildLevels() - " + level->failure);
+		// A level the simplifier got stuck on would only cost memory
+		size_t triangles = level->indices.size() / 3;
+		if (triangles == 0 || triangles * 10 > levels.back().triangles * 9) continue;
+		levels.push_back({ indices.size(), triangles, level->error });
+		indices.insert(indices.end(), level->indices.begin(), level->indices.end());
 	}
-	vcount = int(vertices.size());
+}
 
-	m_vertices = raw_vertices;
-	m_normals = raw_normals;
+void Mesh::upload(const Vtx* vertices, size_t count, const unsigned int* indices, size_t indexCount) {
+	icount = GLsizei(indexCount);
 
 	// Load vertices into OpenGL
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	GLState::bindVertexArray(vao);
 
 	glGenBuffers(1, &vbuf);
 	glBindBuffer(GL_ARRAY_BUFFER, vbuf);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vtx), vertices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(Vtx), vertices, GL_STATIC_DRAW);
 
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vtx), NULL);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vtx), (GLvoid*)sizeof(glm::vec3));
 
-	glBindVertexArray(0);
+	// The index buffer binding is part of the vertex array state
+	glGenBuffers(1, &ibuf);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibuf);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), indices, GL_STATIC_DRAW);
+
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void Mesh::move(const float& offsetX, const float& offsetY, const float& offsetZ)
-{
-	glm::vec3 offset(offsetX, offsetY, offsetZ);
-	currentOffset = offset;
-
-	float roll = currentRotation.x;
-	float pitch = currentRotation.y;
-	float yaw = currentRotation.z;
-	glm::mat3 rx(1.0f, 0.0f, 0.0f, 0.0f, cos(roll), -sin(roll), 0.0f, sin(roll), cos(roll));
-	glm::mat3 ry(cos(pitch), 0.0f, sin(pitch), 0.0f, 1.0f, 0.0f, -sin(pitch), 0.0f, cos(pitch));
-	glm::mat3 rz(cos(yaw), -sin(yaw), 0.0f, sin(yaw), cos(yaw), 0.0f, 0.0f, 0.0f, 1.0f);
-
-	for (int i = 0; i < raw_vertices.size(); i++) {
-		m_vertices[i] = rx * ry * rz * raw_vertices[i];
-		m_vertices[i] = raw_vertices[i] + offset;
+// A cache is used if the source has the size and modification time it was
+// built from; if only the time differs (e.g. after a checkout), the contents decide
+bool Mesh::loadCache(const std::string& path, const SourceStamp& stamp) {
+	bool restamp;
+	try {
+		std::error_code error;
+		if (!std::filesystem::exists(path, error)) return false;
+		MappedFile cache(path);
+		CacheHeader header;
+		if (cache.bytes() < sizeof(header)) return false;
+		std::memcpy(&header, cache.begin(), sizeof(header));
+		if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION
+			|| header.vertexStride != sizeof(Vtx))
+			return false;
+		if (header.sourceSize != stamp.size || (header.sourceTime != stamp.time && header.sourceHash != hashFile(source)))
+			return false;
+		if (header.vertexOffset > cache.bytes() || header.vertexCount > (cache.bytes() - header.vertexOffset) / sizeof(Vtx))
+			return false;
+		if (header.indexOffset > cache.bytes() || header.indexCount > (cache.bytes() - header.indexOffset) / sizeof(unsigned int))
+			return false;
+		if (header.levelCount == 0 || header.levelCount > uint32_t(MAX_LEVELS))
+			return false;
+		for (uint32_t i = 0; i < header.levelCount; i++)
+			if (header.levels[i].firstIndex > header.indexCount
+				|| header.levels[i].triangles > (header.indexCount - header.levels[i].firstIndex) / 3)
+				return false;
+
+		minBB = glm::vec3(header.minBB[0], header.minBB[1], header.minBB[2]);
+		maxBB = glm::vec3(header.maxBB[0], header.maxBB[1], header.maxBB[2]);
+		levels.clear();
+		for (uint32_t i = 0; i < header.levelCount; i++)
+			levels.push_back({ size_t(header.levels[i].firstIndex), size_t(header.levels[i].triangles), header.levels[i].error });
+		meshStats.triangles = levels[0].triangles;
+		meshStats.vertices = size_t(header.vertexCount);
+		meshStats.acmrFileOrder = header.acmrFileOrder;
+		meshStats.acmrOptimized = header.acmrOptimized;
+		upload((const Vtx*)(cache.begin() + header.vertexOffset), size_t(header.vertexCount),
+			(const unsigned int*)(cache.begin() + header.indexOffset), size_t(header.indexCount));
+		restamp = header.sourceTime != stamp.time;
+	} catch (const std::exception&) {
+		return false;
 	}
 
-	// Create vertex array
-	std::vector<Vtx> vertices(v_elements.size());
-	for (int i = 0; i < v_elements.size(); i += 3) {
-		// Store positions
-		vertices[i + 0].pos = m_vertices[v_elements[i + 0]];
-		vertices[i + 1].pos = m_vertices[v_elements[i + 1]];
-		vertices[i + 2].pos = m_vertices[v_elements[i + 2]];
-
-		// Check for normals
-		if (n_elements.size() > 0) {
-			// Store normals
-			vertices[i + 0].norm = m_normals[n_elements[i + 0]];
-			vertices[i + 1].norm = m_normals[n_elements[i + 1]];
-			vertices[i + 2].norm = m_normals[n_elements[i + 2]];
-		}
-		else {
-			// Calculate normal
-			glm::vec3 normal = normalize(cross(vertices[i + 1].pos - vertices[i + 0].pos,
-				vertices[i + 2].pos - vertices[i + 0].pos));
-			vertices[i + 0].norm = normal;
-			vertices[i + 1].norm = normal;
-			vertices[i + 2].norm = normal;
-		}
+	// The contents matched, so record the new time (now that the cache is
+	// unmapped) and later starts skip hashing; failing only costs that hash
+	if (restamp) {
+		std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(offsetof(CacheHeader, sourceTime));
+		file.write((const char*)&stamp.time, sizeof(stamp.time));
 	}
-	vcount = int(vertices.size());
-
-	// Load vertices into OpenGL
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	return true;
+}
 
-	glGenBuffers(1, &vbuf);
-	glBindBuffer(GL_ARRAY_BUFFER, vbuf);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vtx), vertices.data(), GL_STATIC_DRAW);
+// Written to a temporary file first, so a reader never sees a partial cache
+void Mesh::writeCache(const std::string& path, const SourceStamp& stamp, const std::vector<Vtx>& vertices,
+	const std::vector<unsigned int>& indices) const {
+	CacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.vertexStride = sizeof(Vtx);
+	header.sourceSize = stamp.size;
+	header.sourceTime = stamp.time;
+	header.sourceHash = hashFile(source);
+	for (int i = 0; i < 3; i++) {
+		header.minBB[i] = minBB[i];
+		header.maxBB[i] = maxBB[i];
+	}
+	header.vertexCount = vertices.size();
+	header.vertexOffset = alignCache(sizeof(header));
+	header.indexCount = indices.size();
+	header.indexOffset = alignCache(header.vertexOffset + vertices.size() * sizeof(Vtx));
+	header.acmrFileOrder = meshStats.acmrFileOrder;
+	header.acmrOptimized = meshStats.acmrOptimized;
+	header.levelCount = uint32_t(levels.size());
+	for (size_t i = 0; i < levels.size(); i++) {
+		header.levels[i].firstIndex = levels[i].firstIndex;
+		header.levels[i].triangles = levels[i].triangles;
+		header.levels[i].error = levels[i].error;
+	}
 
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vtx), NULL);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vtx), (GLvoid*)sizeof(glm::vec3));
+	std::string temporary = path + ".tmp";
+	std::ofstream out(temporary, std::ios::binary);
+	std::vector<char> padding(size_t(header.vertexOffset - sizeof(header)), 0);
+	out.write((const char*)&header, sizeof(header));
+	out.write(padding.data(), padding.size());
+	out.write((const char*)vertices.data(), vertices.size() * sizeof(Vtx));
+	padding.assign(size_t(header.indexOffset - header.vertexOffset - vertices.size() * sizeof(Vtx)), 0);
+	out.write(padding.data(), padding.size());
+	out.write((const char*)indices.data(), indices.size() * sizeof(unsigned int));
+	out.close();
+
+	// Not being able to cache (e.g. a read-only directory) only costs the next start
+	std::error_code error;
+	if (out) std::filesystem::rename(temporary, path, error);
+	if (!out || error) {
+		std::cerr << "Mesh::writeCache() - Could not write " << path << std::endl;
+		std::filesystem::remove(temporary, error);
+	}
+}
 
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+void Mesh::move(const float& offsetX, const float& offsetY, const float& offsetZ)
+{
+	glm::vec3 offset(offsetX, offsetY, offsetZ);
+	if (offset == currentOffset) return;
+	currentOffset = offset;
+	transformedDirty = true;
 }
 
 void Mesh::rotate(const float& roll, const float& pitch, const float& yaw) {
 	glm::vec3 rotation(roll, pitch, yaw);
+	if (rotation == currentRotation) return;
 	currentRotation = rotation;
+	transformedDirty = true;
+}
 
+glm::mat4 Mesh::modelMatrix() const {
+	float roll = currentRotation.x;
+	float pitch = currentRotation.y;
+	float yaw = currentRotation.z;
 	glm::mat3 rx(1.0f, 0.0f, 0.0f, 0.0f, cos(roll), -sin(roll), 0.0f, sin(roll), cos(roll));
 	glm::mat3 ry(cos(pitch), 0.0f, sin(pitch), 0.0f, 1.0f, 0.0f, -sin(pitch), 0.0f, cos(pitch));
 	glm::mat3 rz(cos(yaw), -sin(yaw), 0.0f, sin(yaw), cos(yaw), 0.0f, 0.0f, 0.0f, 1.0f);
 
-	for (int i = 0; i < raw_vertices.size(); i++) {
-		m_vertices[i] = rx * ry * rz * raw_vertices[i];
-		m_vertices[i] += currentOffset;
-	}
-
-	// Create vertex array
-	std::vector<Vtx> vertices(v_elements.size());
-	for (int i = 0; i < v_elements.size(); i += 3) {
-		// Store positions
-		vertices[i + 0].pos = m_vertices[v_elements[i + 0]];
-		vertices[i + 1].pos = m_vertices[v_elements[i + 1]];
-		vertices[i + 2].pos = m_vertices[v_elements[i + 2]];
-
-		// Check for normals
-		if (n_elements.size() > 0) {
-			// Store normals
-			vertices[i + 0].norm = m_normals[n_elements[i + 0]];
-			vertices[i + 1].norm = m_normals[n_elements[i + 1]];
-			vertices[i + 2].norm = m_normals[n_elements[i + 2]];
-		}
-		else {
-			// Calculate normal
-			glm::vec3 normal = normalize(cross(vertices[i + 1].pos - vertices[i + 0].pos,
-				vertices[i + 2].pos - vertices[i + 0].pos));
-			vertices[i + 0].norm = normal;
-			vertices[i + 1].norm = normal;
-			vertices[i + 2].norm = normal;
-		}
-	}
-	vcount = int(vertices.size());
-
-	// Load vertices into OpenGL
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-
-	glGenBuffers(1, &vbuf);
-	glBindBuffer(GL_ARRAY_BUFFER, vbuf);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vtx), vertices.data(), GL_STATIC_DRAW);
-
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vtx), NULL);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vtx), (GLvoid*)sizeof(glm::vec3));
+	glm::mat4 model(rx * ry * rz);
+	model[3] = glm::vec4(currentOffset, 1.0f);
+	return model;
+}
 
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+// Transformed copies of the vertices are only needed by CPU-side queries
+void Mesh::updateTransformed() {
+	// A cached mesh has only its GPU buffers until the CPU-side arrays are asked for
+	if (fromCache && raw_vertices.empty())
+		loadSource();
+	if (!transformedDirty) return;
+
+	glm::mat4 model = modelMatrix();
+	glm::mat3 rotation(model);
+	m_vertices.resize(raw_vertices.size());
+	for (size_t i = 0; i < raw_vertices.size(); i++)
+		m_vertices[i] = glm::vec3(model * glm::vec4(raw_vertices[i], 1.0f));
+	m_normals.resize(raw_normals.size());
+	for (size_t i = 0; i < raw_normals.size(); i++)
+		m_normals[i] = rotation * raw_normals[i];
+
+	transformedDirty = false;
 }
 
 void Mesh::getVerticesPos(std::vector<glm::vec3>& verticesOut, std::vector<unsigned int>& elementsOut) {
+	updateTransformed();
 	verticesOut.clear();
 	verticesOut = m_vertices;
 	elementsOut.clear();
@@ -276,6 +433,7 @@ void Mesh::getVerticesPos(std::vector<glm::vec3>& verticesOut, std::vector<unsig
 }
 
 void Mesh::getVerticesNorm(std::vector<glm::vec3>& normalOut, std::vector<unsigned int>& elementsOut) {
+	updateTransformed();
 	normalOut.clear();
 	normalOut = m_normals;
 	elementsOut.clear();
@@ -287,9 +445,12 @@ void Mesh::release() {
 	minBB = glm::vec3(std::numeric_limits<float>::max());
 	maxBB = glm::vec3(std::numeric_limits<float>::lowest());
 
-	if (vao) { glDeleteVertexArrays(1, &vao); vao = 0; }
+	if (vao) { GLState::forgetVertexArray(vao); glDeleteVertexArrays(1, &vao); vao = 0; }
 	if (vbuf) { glDeleteBuffers(1, &vbuf); vbuf = 0; }
-	vcount = 0;
+	if (ibuf) { glDeleteBuffers(1, &ibuf); ibuf = 0; }
+	icount = 0;
+	meshStats = Stats();
+	levels.clear();
 
 	raw_vertices.clear();
 	raw_normals.clear();
@@ -298,27 +459,3 @@ void Mesh::release() {
 	v_elements.clear();
 	n_elements.clear();
 }
-
-int indexOfNumberLetter(std::string& str, int offset) {
-	for (int i = offset; i < str.length(); ++i) {
-		if ((str[i] >= '0' && str[i] <= '9') || str[i] == '-' || str[i] == '.') return i;
-	}
-	return int(str.length());
-}
-int lastIndexOfNumberLetter(std::string& str) {
-	for (int i = int(str.length()) - 1; i >= 0; --i) {
-		if ((str[i] >= '0' && str[i] <= '9') || str[i] == '-' || str[i] == '.') return i;
-	}
-	return 0;
-}
-std::vector<std::string> split(const std::string& s, char delim) {
-	std::vector<std::string> elems;
-
-	std::stringstream ss(s);
-	std::string item;
-	while (getline(ss, item, delim)) {
-		elems.push_back(item);
-	}
-
-	return elems;
-}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "mesh_optimizer.hpp"
+#include <cmath>
+#include <algorithm>
+
+namespace {
+	const int CACHE_SIZE = 32;		// Simulated LRU cache of the Forsyth scores
+
+	float vertexScore(int cachePosition, unsigned int remaining) {
+		// Vertices without triangles left are never picked again
+		if (remaining == 0) return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0) {
+			// The last triangle's vertices get a fixed score, so its neighbors do not
+			// simply reuse the same edge over and over (long strips thrash the cache)
+			if (cachePosition < 3) score = 0.75f;
+			else score = std::pow(1.0f - float(cachePosition - 3) / float(CACHE_SIZE - 3), 1.5f);
+		}
+		// Finish off vertices with few triangles left, they would otherwise be transformed again later
+		return score + 2.0f / std::sqrt(float(remaining));
+	}
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount) {
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return;
+
+	// Triangles of every vertex (the first remaining[v] entries of its range are still to be emitted)
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	for (auto i = indices.begin(); i != indices.end(); ++i)
+		remaining[*i]++;
+	std::vector<size_t> first(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		first[v + 1] = first[v] + remaining[v];
+	std::vector<unsigned int> adjacency(indices.size());
+	std::vector<size_t> fill(first.begin(), first.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+		adjacency[fill[indices[i]]++] = unsigned(i / 3);
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> score(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		score[v] = vertexScore(-1, remaining[v]);
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	std::vector<unsigned int> cache, nextCache;
+	cache.reserve(CACHE_SIZE + 3);
+	nextCache.reserve(CACHE_SIZE + 3);
+
+	size_t best = std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin();
+	size_t scan = 0;		// Triangles before it have all been emitted
+	for (size_t n = 0; n < triangleCount; n++) {
+		if (best == triangleCount) {
+			// No candidate next to the cache: continue with the first triangle left
+			while (emitted[scan]) scan++;
+			best = scan;
+		}
+
+		// Emit the triangle and take it out of its vertices' lists
+		emitted[best] = true;
+		const unsigned int* tri = &indices[3 * best];
+		for (int c = 0; c < 3; c++) {
+			unsigned int v = tri[c];
+			result.push_back(v);
+			unsigned int* list = &adjacency[first[v]];
+			unsigned int* end = list + remaining[v];
+			std::iter_swap(std::find(list, end, unsigned(best)), end - 1);
+			remaining[v]--;
+		}
+
+		// Its vertices move to the front of the cache, the oldest ones drop out
+		nextCache.clear();
+		for (int c = 0; c < 3; c++)
+			if (std::find(nextCache.begin(), nextCache.end(), tri[c]) == nextCache.end())
+				nextCache.push_back(tri[c]);
+		for (auto v = cache.begin(); v != cache.end(); ++v)
+			if (*v != tri[0] && *v != tri[1] && *v != tri[2])
+				nextCache.push_back(*v);
+		for (size_t i = CACHE_SIZE; i < nextCache.size(); i++) {
+			cachePosition[nextCache[i]] = -1;
+			score[nextCache[i]] = vertexScore(-1, remaining[nextCache[i]]);
+		}
+		if (nextCache.size() > size_t(CACHE_SIZE)) nextCache.resize(CACHE_SIZE);
+		for (size_t i = 0; i < nextCache.size(); i++) {
+			cachePosition[nextCache[i]] = int(i);
+			score[nextCache[i]] = vertexScore(int(i), remaining[nextCache[i]]);
+		}
+		std::swap(cache, nextCache);
+
+		// Rescore the triangles around the cache and pick the best of them
+		best = triangleCount;
+		float bestScore = -1.0f;
+		for (auto v = cache.begin(); v != cache.end(); ++v) {
+			for (size_t a = first[*v]; a < first[*v] + remaining[*v]; a++) {
+				unsigned int t = adjacency[a];
+				const unsigned int* corners = &indices[3 * t];
+				triangleScore[t] = score[corners[0]] + score[corners[1]] + score[corners[2]];
+				if (triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+	}
+	indices.swap(result);
+}
+
+std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount) {
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(vertexCount, unused);
+	unsigned int next = 0;
+	for (auto i = indices.begin(); i != indices.end(); ++i) {
+		if (remap[*i] == unused)
+			remap[*i] = next++;
+		*i = remap[*i];
+	}
+	for (auto r = remap.begin(); r != remap.end(); ++r)
+		if (*r == unused) *r = next++;
+	return remap;
+}
+
+float averageCacheMissRatio(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize) {
+	if (indices.size() < 3) return 0.0f;
+
+	// A vertex is cached if fewer than cacheSize misses happened since its own
+	const size_t never = ~size_t(0);
+	std::vector<size_t> missAt(vertexCount, never);
+	size_t misses = 0;
+	for (auto i = indices.begin(); i != indices.end(); ++i) {
+		if (missAt[*i] == never || misses - missAt[*i] >= size_t(cacheSize))
+			missAt[*i] = misses++;
+	}
+	return float(misses) / float(indices.size() / 3);
+}
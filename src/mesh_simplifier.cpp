@@ -0,0 +1,271 @@
+#include "mesh_simplifier.hpp"
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+namespace {
+	// Planes through the open borders count this much more than the faces, so borders stay put
+	const double BORDER_WEIGHT = 10.0;
+	// A collapse may turn a remaining triangle by up to about 75 degrees
+	const double MIN_NORMAL_COSINE = 0.25;
+	// Collapses per pass whose cost may exceed the cost of the quota-th cheapest edge
+	const double COST_SLACK = 1.5;
+
+	// Weighted sum of squared distances to planes: p^T A p + 2 b.p + c, divided by the weights
+	struct Quadric {
+		double a00, a01, a02, a11, a12, a22;
+		double b0, b1, b2;
+		double c;
+		double weight;
+	};
+
+	void addPlane(Quadric& q, const glm::dvec3& n, double d, double weight) {
+		q.a00 += weight * n.x * n.x; q.a01 += weight * n.x * n.y; q.a02 += weight * n.x * n.z;
+		q.a11 += weight * n.y * n.y; q.a12 += weight * n.y * n.z; q.a22 += weight * n.z * n.z;
+		q.b0 += weight * n.x * d; q.b1 += weight * n.y * d; q.b2 += weight * n.z * d;
+		q.c += weight * d * d;
+		q.weight += weight;
+	}
+
+	void addQuadric(Quadric& q, const Quadric& other) {
+		q.a00 += other.a00; q.a01 += other.a01; q.a02 += other.a02;
+		q.a11 += other.a11; q.a12 += other.a12; q.a22 += other.a22;
+		q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+		q.c += other.c;
+		q.weight += other.weight;
+	}
+
+	// Mean squared distance of p to the planes
+	double evaluate(const Quadric& q, const glm::vec3& p) {
+		if (q.weight <= 0.0) return 0.0;
+		double x = p.x, y = p.y, z = p.z;
+		double r = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+			+ 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+			+ 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+		return std::max(r, 0.0) / q.weight;
+	}
+
+	// Undirected edge of a triangle
+	struct Edge {
+		unsigned int low, high;
+		unsigned int triangle;
+		bool operator<(const Edge& other) const {
+			return low != other.low ? low < other.low : high < other.high;
+		}
+	};
+
+	struct Collapse {
+		double cost;
+		unsigned int from, to;
+		bool operator<(const Collapse& other) const { return cost < other.cost; }
+	};
+
+	// Edges of all triangles, sorted so the triangles of an edge are adjacent
+	std::vector<Edge> collectEdges(const std::vector<unsigned int>& triangles) {
+		std::vector<Edge> edges(triangles.size());
+		for (size_t i = 0; i < triangles.size(); i++) {
+			unsigned int a = triangles[i];
+			unsigned int b = triangles[i - i % 3 + (i + 1) % 3];
+			edges[i] = { std::min(a, b), std::max(a, b), unsigned(i / 3) };
+		}
+		std::sort(edges.begin(), edges.end());
+		return edges;
+	}
+
+	glm::vec3 triangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+		return glm::cross(b - a, c - a);
+	}
+}
+
+std::vector<unsigned int> simplifyMesh(const std::vector<glm::vec3>& positions,
+	const std::vector<unsigned int>& indices, size_t targetTriangles, float& error) {
+	size_t vertexCount = positions.size();
+	double maxCost = 0.0;
+
+	// Vertices at the same position are simplified as one
+	std::vector<unsigned int> order(vertexCount);
+	std::iota(order.begin(), order.end(), 0u);
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+		const glm::vec3& p = positions[a];
+		const glm::vec3& q = positions[b];
+		return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+	});
+	std::vector<unsigned int> remap(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+		remap[order[i]] = i > 0 && positions[order[i]] == positions[order[i - 1]] ? remap[order[i - 1]] : order[i];
+
+	std::vector<unsigned int> triangles;
+	triangles.reserve(indices.size());
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+		if (a == b || b == c || c == a) continue;
+		triangles.push_back(a);
+		triangles.push_back(b);
+		triangles.push_back(c);
+	}
+
+	// Every vertex starts with the planes of its faces (weighted by area) and of its open borders
+	std::vector<Quadric> quadrics(vertexCount, Quadric());
+	for (size_t i = 0; i < triangles.size(); i += 3) {
+		glm::dvec3 normal = triangleNormal(positions[triangles[i]], positions[triangles[i + 1]], positions[triangles[i + 2]]);
+		double area = glm::length(normal);
+		if (area == 0.0) continue;
+		normal /= area;
+		double d = -glm::dot(normal, glm::dvec3(positions[triangles[i]]));
+		for (int c = 0; c < 3; c++)
+			addPlane(quadrics[triangles[i + c]], normal, d, 0.5 * area);
+	}
+	std::vector<Edge> edges = collectEdges(triangles);
+	for (size_t e = 0; e < edges.size(); e++) {
+		bool shared = (e > 0 && !(edges[e - 1] < edges[e])) || (e + 1 < edges.size() && !(edges[e] < edges[e + 1]));
+		if (shared) continue;
+		const unsigned int* tri = &triangles[3 * edges[e].triangle];
+		glm::dvec3 a = positions[edges[e].low], b = positions[edges[e].high];
+		glm::dvec3 faceNormal = triangleNormal(positions[tri[0]], positions[tri[1]], positions[tri[2]]);
+		glm::dvec3 normal = glm::cross(b - a, faceNormal);
+		double length = glm::length(normal);
+		if (length == 0.0) continue;
+		normal /= length;
+		double d = -glm::dot(normal, a);
+		double weight = BORDER_WEIGHT * glm::dot(b - a, b - a);
+		addPlane(quadrics[edges[e].low], normal, d, weight);
+		addPlane(quadrics[edges[e].high], normal, d, weight);
+	}
+
+	// Each pass collapses the cheapest edges whose neighborhoods do not overlap
+	std::vector<size_t> first(vertexCount + 1);
+	std::vector<unsigned int> adjacency;
+	std::vector<unsigned char> border(vertexCount), locked(vertexCount);
+	std::vector<unsigned int> collapsedTo(vertexCount);
+	std::vector<Collapse> candidates;
+	std::vector<unsigned int> fromNeighbors, toNeighbors;
+	while (triangles.size() / 3 > targetTriangles) {
+		size_t triangleCount = triangles.size() / 3;
+
+		// Triangles of every vertex
+		std::fill(first.begin(), first.end(), 0);
+		for (auto i = triangles.begin(); i != triangles.end(); ++i)
+			first[*i + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			first[v + 1] += first[v];
+		adjacency.resize(triangles.size());
+		std::vector<size_t> fill(first.begin(), first.end() - 1);
+		for (size_t i = 0; i < triangles.size(); i++)
+			adjacency[fill[triangles[i]]++] = unsigned(i / 3);
+
+		// Vertices on open borders may only slide along them, non-manifold ones stay
+		edges = collectEdges(triangles);
+		std::fill(border.begin(), border.end(), 0);
+		std::fill(locked.begin(), locked.end(), 0);
+		for (size_t e = 0, next; e < edges.size(); e = next) {
+			for (next = e + 1; next < edges.size() && !(edges[e] < edges[next]); next++);
+			if (next - e == 1) border[edges[e].low] = border[edges[e].high] = 1;
+			if (next - e > 2) locked[edges[e].low] = locked[edges[e].high] = 1;
+		}
+
+		candidates.clear();
+		for (size_t e = 0, next; e < edges.size(); e = next) {
+			for (next = e + 1; next < edges.size() && !(edges[e] < edges[next]); next++);
+			unsigned int a = edges[e].low, b = edges[e].high;
+			bool borderEdge = next - e == 1;
+			if (next - e > 2) continue;
+
+			Quadric q = quadrics[a];
+			addQuadric(q, quadrics[b]);
+			Collapse best = { -1.0, 0, 0 };
+			for (int direction = 0; direction < 2; direction++) {
+				unsigned int from = direction ? b : a, to = direction ? a : b;
+				// A border vertex leaving its border would tear the mesh open
+				if (border[from] && !borderEdge) continue;
+				double cost = evaluate(q, positions[to]);
+				if (best.cost < 0.0 || cost < best.cost)
+					best = { cost, from, to };
+			}
+			if (best.cost >= 0.0)
+				candidates.push_back(best);
+		}
+		if (candidates.empty()) break;
+		std::sort(candidates.begin(), candidates.end());
+
+		// An interior collapse removes two triangles, a border one one
+		size_t quota = (triangleCount - targetTriangles) / 2 + 1;
+		double costLimit = candidates[std::min(quota, candidates.size()) - 1].cost * COST_SLACK;
+
+		std::iota(collapsedTo.begin(), collapsedTo.end(), 0u);
+		size_t collapses = 0;
+		for (auto c = candidates.begin(); c != candidates.end() && collapses < quota; ++c) {
+			if (c->cost > costLimit && collapses > 0) break;
+			unsigned int from = c->from, to = c->to;
+			if (locked[from] || locked[to]) continue;
+
+			// The surface must stay manifold: the only neighbors both vertices share
+			// are the third corners of the triangles on their edge
+			fromNeighbors.clear();
+			toNeighbors.clear();
+			size_t sharedTriangles = 0;
+			for (size_t a = first[from]; a < first[from + 1]; a++) {
+				const unsigned int* tri = &triangles[3 * adjacency[a]];
+				if (tri[0] == to || tri[1] == to || tri[2] == to) sharedTriangles++;
+				for (int k = 0; k < 3; k++)
+					if (tri[k] != from) fromNeighbors.push_back(tri[k]);
+			}
+			for (size_t a = first[to]; a < first[to + 1]; a++) {
+				const unsigned int* tri = &triangles[3 * adjacency[a]];
+				for (int k = 0; k < 3; k++)
+					if (tri[k] != to) toNeighbors.push_back(tri[k]);
+			}
+			std::sort(fromNeighbors.begin(), fromNeighbors.end());
+			fromNeighbors.erase(std::unique(fromNeighbors.begin(), fromNeighbors.end()), fromNeighbors.end());
+			std::sort(toNeighbors.begin(), toNeighbors.end());
+			toNeighbors.erase(std::unique(toNeighbors.begin(), toNeighbors.end()), toNeighbors.end());
+			size_t common = 0;
+			for (auto n = fromNeighbors.begin(), m = toNeighbors.begin(); n != fromNeighbors.end() && m != toNeighbors.end();) {
+				if (*n < *m) ++n;
+				else if (*m < *n) ++m;
+				else { common++; ++n; ++m; }
+			}
+			if (common != sharedTriangles) continue;
+
+			// No remaining triangle may flip or fold over
+			bool flips = false;
+			for (size_t a = first[from]; a < first[from + 1] && !flips; a++) {
+				const unsigned int* tri = &triangles[3 * adjacency[a]];
+				if (tri[0] == to || tri[1] == to || tri[2] == to) continue;
+				glm::vec3 corners[3], moved[3];
+				for (int k = 0; k < 3; k++) {
+					corners[k] = positions[tri[k]];
+					moved[k] = tri[k] == from ? positions[to] : corners[k];
+				}
+				glm::dvec3 before = triangleNormal(corners[0], corners[1], corners[2]);
+				glm::dvec3 after = triangleNormal(moved[0], moved[1], moved[2]);
+				flips = glm::dot(before, after) <= MIN_NORMAL_COSINE * glm::length(before) * glm::length(after);
+			}
+			if (flips) continue;
+
+			collapsedTo[from] = to;
+			addQuadric(quadrics[to], quadrics[from]);
+			maxCost = std::max(maxCost, c->cost);
+			collapses++;
+			// Flip checks of this pass assume the neighborhood did not move
+			locked[to] = 1;
+			for (auto n = fromNeighbors.begin(); n != fromNeighbors.end(); ++n)
+				locked[*n] = 1;
+			locked[from] = 1;
+		}
+		if (collapses == 0) break;
+
+		// Move the collapsed corners and drop the triangles that became degenerate
+		size_t kept = 0;
+		for (size_t i = 0; i < triangles.size(); i += 3) {
+			unsigned int a = collapsedTo[triangles[i]], b = collapsedTo[triangles[i + 1]], c = collapsedTo[triangles[i + 2]];
+			if (a == b || b == c || c == a) continue;
+			triangles[kept++] = a;
+			triangles[kept++] = b;
+			triangles[kept++] = c;
+		}
+		triangles.resize(kept);
+	}
+
+	error = float(std::sqrt(maxCost));
+	return triangles;
+}
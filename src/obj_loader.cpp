@@ -0,0 +1,328 @@
+#include "obj_loader.hpp"
+#include "cpu_trace.hpp"
+#include "mapped_file.hpp"
+#include <charconv>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+	// Chunks are at least this large, smaller files are parsed by one thread
+	const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+	// Part of the file parsed by one thread
+	struct Chunk {
+		const char* begin;
+		const char* end;
+		ObjGeometry geometry;
+		// Index entries counted from the chunk's first element (negative OBJ indices);
+		// merging adds the number of elements in the chunks before
+		std::vector<size_t> relativePositions;
+		std::vector<size_t> relativeNormals;
+		const char* errorLine;		// First malformed line (NULL if none)
+		std::string error;			// Exception thrown by the parser thread
+	};
+
+	// Face corner: v, v/vt, v//vn or v/vt/vn
+	struct Corner {
+		unsigned position;
+		unsigned normal;
+		bool positionRelative;
+		bool normalRelative;
+		bool hasNormal;
+	};
+
+	inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline const char* skipBlanks(const char* p, const char* end) {
+		while (p < end && isBlank(*p)) p++;
+		return p;
+	}
+
+	// NULL if there is no number
+	const char* parseVec3(const char* p, const char* end, glm::vec3& v) {
+		for (int i = 0; i < 3; i++) {
+			p = skipBlanks(p, end);
+			if (p < end && *p == '+') p++;
+			std::from_chars_result r = std::from_chars(p, end, v[i]);
+			if (r.ec != std::errc()) return NULL;
+			p = r.ptr;
+		}
+		return p;
+	}
+
+	// 1-based OBJ index to 0-based; a negative one counts back from the last of count elements
+	const char* parseIndex(const char* p, const char* end, size_t count, unsigned& index, bool& relative) {
+		long value = 0;
+		std::from_chars_result r = std::from_chars(p, end, value);
+		if (r.ec != std::errc() || value == 0) return NULL;
+		relative = value < 0;
+		// Wraps around if it points into an earlier chunk, adding the offset undoes that
+		index = relative ? unsigned(long(count) + value) : unsigned(value - 1);
+		return r.ptr;
+	}
+
+	const char* parseCorner(const char* p, const char* end, const ObjGeometry& g, Corner& c) {
+		p = parseIndex(p, end, g.positions.size(), c.position, c.positionRelative);
+		if (!p) return NULL;
+		c.hasNormal = false;
+		if (p < end && *p == '/') {
+			// Texture coordinates are not used
+			for (p++; p < end && *p != '/' && !isBlank(*p); p++);
+			if (p < end && *p == '/') {
+				p = parseIndex(p + 1, end, g.normals.size(), c.normal, c.normalRelative);
+				if (!p) return NULL;
+				c.hasNormal = true;
+			}
+		}
+		return p;
+	}
+
+	void addCorner(Chunk& chunk, const Corner& c) {
+		ObjGeometry& g = chunk.geometry;
+		if (c.positionRelative) chunk.relativePositions.push_back(g.positionIndices.size());
+		g.positionIndices.push_back(c.position);
+		if (!c.hasNormal) return;
+		if (c.normalRelative) chunk.relativeNormals.push_back(g.normalIndices.size());
+		g.normalIndices.push_back(c.normal);
+	}
+
+	// One line without its newline; false if it is malformed
+	bool parseLine(Chunk& chunk, const char* p, const char* end) {
+		ObjGeometry& g = chunk.geometry;
+		p = skipBlanks(p, end);
+		if (end - p < 2) return true;
+
+		if (p[0] == 'v' && isBlank(p[1])) {
+			glm::vec3 v;
+			if (!parseVec3(p + 2, end, v)) return false;
+			g.positions.push_back(v);
+			g.minBB = glm::min(g.minBB, v);
+			g.maxBB = glm::max(g.maxBB, v);
+		}
+		else if (p[0] == 'v' && p[1] == 'n' && end - p > 2 && isBlank(p[2])) {
+			glm::vec3 n;
+			if (!parseVec3(p + 3, end, n)) return false;
+			g.normals.push_back(n);
+		}
+		else if (p[0] == 'f' && isBlank(p[1])) {
+			// Split into a triangle fan around the first corner
+			Corner first, previous, c;
+			int corners = 0;
+			for (p = skipBlanks(p + 2, end); p < end && *p != '#'; p = skipBlanks(p, end)) {
+				p = parseCorner(p, end, g, c);
+				if (!p || (corners > 0 && c.hasNormal != first.hasNormal)) return false;
+				if (corners == 0) first = c;
+				if (corners >= 2) {
+					addCorner(chunk, first);
+					addCorner(chunk, previous);
+					addCorner(chunk, c);
+				}
+				previous = c;
+				corners++;
+			}
+			if (corners < 3) return false;
+		}
+		return true;
+	}
+
+	void parseChunk(Chunk& chunk) {
+		CPU_TRACE_SCOPE("loadObj chunk");
+		try {
+			for (const char* line = chunk.begin; line < chunk.end;) {
+				const char* eol = (const char*)std::memchr(line, '\n', chunk.end - line);
+				if (!eol) eol = chunk.end;
+				if (!parseLine(chunk, line, eol)) {
+					chunk.errorLine = line;
+					return;
+				}
+				line = eol + 1;
+			}
+		} catch (const std::exception& e) {
+			chunk.error = e.what();
+		}
+	}
+
+	// Append a chunk, turning its relative indices into absolute ones
+	void merge(ObjGeometry& g, const Chunk& chunk) {
+		const ObjGeometry& c = chunk.geometry;
+		unsigned positionBase = unsigned(g.positions.size());
+		unsigned normalBase = unsigned(g.normals.size());
+		size_t positionIndexBase = g.positionIndices.size();
+		size_t normalIndexBase = g.normalIndices.size();
+
+		g.positions.insert(g.positions.end(), c.positions.begin(), c.positions.end());
+		g.normals.insert(g.normals.end(), c.normals.begin(), c.normals.end());
+		g.positionIndices.insert(g.positionIndices.end(), c.positionIndices.begin(), c.positionIndices.end());
+		g.normalIndices.insert(g.normalIndices.end(), c.normalIndices.begin(), c.normalIndices.end());
+		for (auto r = chunk.relativePositions.begin(); r != chunk.relativePositions.end(); ++r)
+			g.positionIndices[positionIndexBase + *r] += positionBase;
+		for (auto r = chunk.relativeNormals.begin(); r != chunk.relativeNormals.end(); ++r)
+			g.normalIndices[normalIndexBase + *r] += normalBase;
+
+		g.minBB = glm::min(g.minBB, c.minBB);
+		g.maxBB = glm::max(g.maxBB, c.maxBB);
+	}
+}
+
+ObjGeometry loadObj(const std::string& path, int threads) {
+	MappedFile file(path);
+
+	// Chunks end at line boundaries
+	if (threads <= 0)
+		threads = std::max(int(std::thread::hardware_concurrency()), 1);
+	size_t chunkCount = std::max(std::min(size_t(threads), file.bytes() / MIN_CHUNK_SIZE), size_t(1));
+	std::vector<Chunk> chunks(chunkCount);
+	const char* start = file.begin();
+	for (size_t i = 0; i < chunkCount; i++) {
+		const char* end = file.begin() + file.bytes() * (i + 1) / chunkCount;
+		if (i + 1 < chunkCount) {
+			const char* eol = end > start ? (const char*)std::memchr(end - 1, '\n', file.end() - end + 1) : NULL;
+			end = eol ? eol + 1 : file.end();
+		}
+		else end = file.end();
+		Chunk& chunk = chunks[i];
+		chunk.begin = start;
+		chunk.end = std::max(start, end);
+		chunk.geometry.minBB = glm::vec3(std::numeric_limits<float>::max());
+		chunk.geometry.maxBB = glm::vec3(std::numeric_limits<float>::lowest());
+		chunk.errorLine = NULL;
+		start = chunk.end;
+	}
+
+	// The first chunk is parsed on this thread
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < chunkCount; i++)
+		workers.push_back(std::thread(parseChunk, std::ref(chunks[i])));
+	parseChunk(chunks[0]);
+	for (auto w = workers.begin(); w != workers.end(); ++w)
+		w->join();
+
+	ObjGeometry g;
+	g.minBB = glm::vec3(std::numeric_limits<float>::max());
+	g.maxBB = glm::vec3(std::numeric_limits<float>::lowest());
+	size_t positions = 0, normals = 0, positionIndices = 0, normalIndices = 0;
+	for (auto c = chunks.begin(); c != chunks.end(); ++c) {
+		if (!c->error.empty())
+			throw std::runtime_error("loadObj() - " + path + ": " + c->error);
+		if (c->errorLine) {
+			const char* eol = (const char*)std::memchr(c->errorLine, '\n', file.end() - c->errorLine);
+			std::string line(c->errorLine, std::min(eol ? eol : file.end(), c->errorLine + 80));
+			throw std::runtime_error("loadObj() - " + path + ": malformed line at byte "
+				+ std::to_string(c->errorLine - file.begin()) + ": " + line);
+		}
+		positions += c->geometry.positions.size();
+		normals += c->geometry.normals.size();
+		positionIndices += c->geometry.positionIndices.size();
+		normalIndices += c->geometry.normalIndices.size();
+	}
+	g.positions.reserve(positions);
+	g.normals.reserve(normals);
+	g.positionIndices.reserve(positionIndices);
+	g.normalIndices.reserve(normalIndices);
+	for (auto c = chunks.begin(); c != chunks.end(); ++c)
+		merge(g, *c);
+
+	// Faces index existing elements, and either all or none of them have normals
+	for (auto i = g.positionIndices.begin(); i != g.positionIndices.end(); ++i)
+		if (*i >= g.positions.size())
+			throw std::runtime_error("loadObj() - " + path + ": face refers to vertex " + std::to_string(*i + 1) + " of " + std::to_string(g.positions.size()));
+	for (auto i = g.normalIndices.begin(); i != g.normalIndices.end(); ++i)
+		if (*i >= g.normals.size())
+			throw std::runtime_error("loadObj() - " + path + ": face refers to normal " + std::to_string(*i + 1) + " of " + std::to_string(g.normals.size()));
+	if (!g.normalIndices.empty() && g.normalIndices.size() != g.positionIndices.size())
+		throw std::runtime_error("loadObj() - " + path + ": only some faces have normals");
+	return g;
+}
+
+// Helper functions of the stream loader
+namespace {
+	size_t indexOfNumberLetter(std::string& str, size_t offset) {
+		for (size_t i = offset; i < str.length(); ++i) {
+			if ((str[i] >= '0' && str[i] <= '9') || str[i] == '-' || str[i] == '.') return i;
+		}
+		return str.length();
+	}
+	size_t lastIndexOfNumberLetter(std::string& str) {
+		for (size_t i = str.length(); i > 0; --i) {
+			if ((str[i - 1] >= '0' && str[i - 1] <= '9') || str[i - 1] == '-' || str[i - 1] == '.') return i - 1;
+		}
+		return 0;
+	}
+	std::vector<std::string> split(const std::string& s, char delim) {
+		std::vector<std::string> elems;
+
+		std::stringstream ss(s);
+		std::string item;
+		while (getline(ss, item, delim)) {
+			elems.push_back(item);
+		}
+
+		return elems;
+	}
+}
+
+ObjGeometry loadObjStream(const std::string& path) {
+	std::ifstream file(path);
+	if (!file.is_open())
+		throw std::runtime_error("loadObjStream() - Could not open file " + path);
+
+	ObjGeometry g;
+	g.minBB = glm::vec3(std::numeric_limits<float>::max());
+	g.maxBB = glm::vec3(std::numeric_limits<float>::lowest());
+
+	std::string line;
+	while (getline(file, line)) {
+		if (line.substr(0, 2) == "v ") {
+			// Read position data
+			size_t index1 = indexOfNumberLetter(line, 2);
+			size_t index2 = lastIndexOfNumberLetter(line);
+			std::vector<std::string> values = split(line.substr(index1, index2 - index1 + 1), ' ');
+			glm::vec3 vert(stof(values[0]), stof(values[1]), stof(values[2]));
+			g.positions.push_back(vert);
+
+			// Update bounding box
+			g.minBB = glm::min(g.minBB, vert);
+			g.maxBB = glm::max(g.maxBB, vert);
+		}
+		else if (line.substr(0, 3) == "vn ") {
+			// Read normal data
+			size_t index1 = indexOfNumberLetter(line, 2);
+			size_t index2 = lastIndexOfNumberLetter(line);
+			std::vector<std::string> values = split(line.substr(index1, index2 - index1 + 1), ' ');
+			g.normals.push_back(glm::vec3(stof(values[0]), stof(values[1]), stof(values[2])));
+
+		}
+		else if (line.substr(0, 2) == "f ") {
+			// Read face data
+			size_t index1 = indexOfNumberLetter(line, 2);
+			size_t index2 = lastIndexOfNumberLetter(line);
+			std::vector<std::string> values = split(line.substr(index1, index2 - index1 + 1), ' ');
+			if (values.size() < 3)
+				throw std::runtime_error("loadObjStream() - " + path + ": face with fewer than 3 vertices");
+			for (size_t i = 0; i + 2 < values.size(); i++) {
+				// Split up vertex indices
+				std::vector<std::string> v1 = split(values[0], '/');		// Triangle fan for ngons
+				std::vector<std::string> v2 = split(values[i + 1], '/');
+				std::vector<std::string> v3 = split(values[i + 2], '/');
+
+				// Store position indices
+				g.positionIndices.push_back(stoul(v1[0]) - 1);
+				g.positionIndices.push_back(stoul(v2[0]) - 1);
+				g.positionIndices.push_back(stoul(v3[0]) - 1);
+
+				// Check for normals
+				if (v1.size() >= 3 && v1[2].length() > 0) {
+					g.normalIndices.push_back(stoul(v1[2]) - 1);
+					g.normalIndices.push_back(stoul(v2[2]) - 1);
+					g.normalIndices.push_back(stoul(v3[2]) - 1);
+				}
+			}
+		}
+	}
+	return g;
+}
@@ -0,0 +1,307 @@
+#include "render_graph.hpp"
+#include "gl_state.hpp"
+#include "cpu_trace.hpp"
+#include <cassert>
+#include <sstream>
+#include <stdexcept>
+
+// Pooled textures unused for this many frames are released
+const unsigned POOL_IDLE_FRAMES = 30;
+
+bool RenderGraph::TextureDesc::operator==(const TextureDesc& other) const {
+	return width == other.width && height == other.height &&
+		internalFormat == other.internalFormat && format == other.format &&
+		type == other.type && mipmaps == other.mipmaps;
+}
+
+RenderGraph::RenderGraph() {
+	frame = 0;
+	executedPasses = 0;
+	culledPasses = 0;
+	backbuffer = 0;
+}
+
+void RenderGraph::beginFrame() {
+	resources.clear();
+	passes.clear();
+	frame++;
+}
+
+RenderGraph::Resource RenderGraph::importTexture(const std::string& name, GLuint texture, GLsizei width, GLsizei height) {
+	ResourceNode node;
+	node.name = name;
+	node.desc = { width, height, GL_NONE, GL_NONE, GL_NONE, false };
+	node.imported = true;
+	node.output = false;
+	node.texture = texture;
+	node.writer = -1;
+	node.firstUse = -1;
+	node.lastUse = -1;
+	resources.push_back(node);
+	return Resource(resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::importBackbuffer(GLsizei width, GLsizei height, GLuint framebuffer) {
+	Resource res = importTexture("backbuffer", 0, width, height);
+	resources[res].output = true;
+	backbuffer = framebuffer;
+	return res;
+}
+
+RenderGraph::Resource RenderGraph::createTexture(const std::string& name, const TextureDesc& desc) {
+	ResourceNode node;
+	node.name = name;
+	node.desc = desc;
+	node.imported = false;
+	node.output = false;
+	node.texture = 0;
+	node.writer = -1;
+	node.firstUse = -1;
+	node.lastUse = -1;
+	resources.push_back(node);
+	return Resource(resources.size() - 1);
+}
+
+void RenderGraph::markOutput(Resource res) {
+	resources[res].output = true;
+}
+
+void RenderGraph::addPass(const std::string& name, const std::vector<Resource>& reads,
+	const std::vector<Resource>& writes, const PassState& state, PassFunc func) {
+	int index = int(passes.size());
+	for (auto w = writes.begin(); w != writes.end(); ++w) {
+		if (resources[*w].writer != -1) {
+			std::stringstream ss;
+			ss << "RenderGraph::addPass() - " << name << " writes " << resources[*w].name
+				<< " which is already written by " << passes[resources[*w].writer].name;
+			throw std::runtime_error(ss.str());
+		}
+		resources[*w].writer = index;
+	}
+	passes.push_back({ name, reads, writes, state, func });
+}
+
+GLuint RenderGraph::texture(Resource res) const {
+	return resources[res].texture;
+}
+
+void RenderGraph::setPassHooks(PassHook begin, PassHook end) {
+	beginHook = begin;
+	endHook = end;
+}
+
+// Order live passes so that every writer runs before its readers
+std::vector<int> RenderGraph::schedule() {
+	int n = int(passes.size());
+
+	// Cull: walk back from the outputs through the writers of everything read
+	std::vector<bool> live(n, false);
+	std::vector<int> stack;
+	for (auto r = resources.begin(); r != resources.end(); ++r)
+		if (r->output && r->writer != -1 && !live[r->writer]) {
+			live[r->writer] = true;
+			stack.push_back(r->writer);
+		}
+	while (!stack.empty()) {
+		int p = stack.back();
+		stack.pop_back();
+		for (auto r = passes[p].reads.begin(); r != passes[p].reads.end(); ++r) {
+			int w = resources[*r].writer;
+			if (w != -1 && !live[w]) {
+				live[w] = true;
+				stack.push_back(w);
+			}
+		}
+	}
+
+	// Topological sort, ties broken by declaration order
+	std::vector<int> pending(n, 0);
+	std::vector<std::vector<int>> readers(n);
+	for (int p = 0; p < n; p++) {
+		if (!live[p]) continue;
+		for (auto r = passes[p].reads.begin(); r != passes[p].reads.end(); ++r) {
+			int w = resources[*r].writer;
+			if (w != -1 && w != p) {
+				readers[w].push_back(p);
+				pending[p]++;
+			}
+		}
+	}
+	std::vector<int> order;
+	std::vector<bool> done(n, false);
+	while (true) {
+		int next = -1;
+		for (int p = 0; p < n && next == -1; p++)
+			if (live[p] && !done[p] && pending[p] == 0) next = p;
+		if (next == -1) break;
+		done[next] = true;
+		order.push_back(next);
+		for (auto r = readers[next].begin(); r != readers[next].end(); ++r)
+			pending[*r]--;
+	}
+
+	int liveCount = 0;
+	for (int p = 0; p < n; p++)
+		if (live[p]) liveCount++;
+	if (int(order.size()) != liveCount)
+		throw std::runtime_error("RenderGraph::schedule() - Cyclic pass dependencies");
+
+	culledPasses = n - liveCount;
+	return order;
+}
+
+// Back transient resources with pooled textures whose lifetimes do not overlap
+void RenderGraph::allocate(const std::vector<int>& order) {
+	for (int i = 0; i < int(order.size()); i++) {
+		const PassNode& pass = passes[order[i]];
+		for (auto r = pass.reads.begin(); r != pass.reads.end(); ++r) {
+			if (resources[*r].firstUse == -1) resources[*r].firstUse = i;
+			resources[*r].lastUse = i;
+		}
+		for (auto r = pass.writes.begin(); r != pass.writes.end(); ++r) {
+			if (resources[*r].firstUse == -1) resources[*r].firstUse = i;
+			resources[*r].lastUse = i;
+		}
+	}
+
+	for (auto t = pool.begin(); t != pool.end(); ++t)
+		t->freeFrom = 0;
+
+	// Assign in order of first use
+	for (int i = 0; i < int(order.size()); i++) {
+		for (auto r = resources.begin(); r != resources.end(); ++r) {
+			if (r->imported || r->firstUse != i) continue;
+
+			PooledTexture* slot = nullptr;
+			for (auto t = pool.begin(); t != pool.end() && !slot; ++t)
+				if (t->desc == r->desc && t->freeFrom <= i) slot = &*t;
+
+			if (!slot) {
+				PooledTexture t;
+				t.desc = r->desc;
+				glGenTextures(1, &t.texture);
+				GLState::bindTexture(0, GL_TEXTURE_2D, t.texture);
+				glTexImage2D(GL_TEXTURE_2D, 0, t.desc.internalFormat, t.desc.width, t.desc.height, 0, t.desc.format, t.desc.type, NULL);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, t.desc.mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				if (t.desc.mipmaps) glGenerateMipmap(GL_TEXTURE_2D);
+				pool.push_back(t);
+				slot = &pool.back();
+			}
+
+			slot->freeFrom = r->lastUse + 1;
+			slot->lastFrame = frame;
+			r->texture = slot->texture;
+		}
+	}
+
+	// Release textures nobody asked for in a while
+	for (auto t = pool.begin(); t != pool.end();) {
+		if (frame - t->lastFrame > POOL_IDLE_FRAMES) {
+			for (auto f = framebuffers.begin(); f != framebuffers.end();) {
+				bool attached = false;
+				for (auto a = f->first.begin(); a != f->first.end(); ++a)
+					if (*a == t->texture) attached = true;
+				if (attached) {
+					GLState::forgetFramebuffer(f->second);
+					glDeleteFramebuffers(1, &f->second);
+					f = framebuffers.erase(f);
+				}
+				else ++f;
+			}
+			GLState::forgetTexture(t->texture);
+			glDeleteTextures(1, &t->texture);
+			t = pool.erase(t);
+		}
+		else ++t;
+	}
+}
+
+// Framebuffer object for a set of color attachments (created once, then reused)
+GLuint RenderGraph::framebuffer(const std::vector<GLuint>& attachments) {
+	auto it = framebuffers.find(attachments);
+	if (it != framebuffers.end())
+		return it->second;
+
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
+	GLState::bindFramebuffer(fbo);
+	std::vector<GLenum> drawBuffers;
+	for (int i = 0; i < int(attachments.size()); i++) {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, attachments[i], 0);
+		drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+	}
+	glDrawBuffers(GLsizei(drawBuffers.size()), drawBuffers.data());
+	assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+
+	framebuffers[attachments] = fbo;
+	return fbo;
+}
+
+void RenderGraph::bindTargets(const PassNode& pass) {
+	if (pass.writes.empty()) return;
+
+	GLuint fbo = backbuffer;
+	const ResourceNode& first = resources[pass.writes[0]];
+	if (first.texture != 0) {
+		std::vector<GLuint> attachments;
+		for (auto w = pass.writes.begin(); w != pass.writes.end(); ++w)
+			attachments.push_back(resources[*w].texture);
+		fbo = framebuffer(attachments);
+	}
+
+	GLState::bindFramebuffer(fbo);
+	GLState::viewport(first.desc.width, first.desc.height);
+}
+
+void RenderGraph::execute() {
+	std::vector<int> order;
+	{
+		CPU_TRACE_SCOPE("RenderGraph schedule");
+		order = schedule();
+		allocate(order);
+	}
+
+	for (auto p = order.begin(); p != order.end(); ++p) {
+		const PassNode& pass = passes[*p];
+		CPU_TRACE_SCOPE(pass.name);
+		if (beginHook) beginHook(pass.name);
+
+		bindTargets(pass);
+		if (pass.state.blend) GLState::enable(GL_BLEND);
+		else GLState::disable(GL_BLEND);
+		if (pass.state.clearMask)
+			glClear(pass.state.clearMask);
+
+		pass.func();
+
+		// Keep mip chains of written targets up to date
+		for (auto w = pass.writes.begin(); w != pass.writes.end(); ++w) {
+			if (resources[*w].desc.mipmaps && resources[*w].texture) {
+				GLState::bindTexture(0, GL_TEXTURE_2D, resources[*w].texture);
+				glGenerateMipmap(GL_TEXTURE_2D);
+			}
+		}
+
+		if (endHook) endHook(pass.name);
+	}
+	executedPasses = int(order.size());
+}
+
+// Release resources
+void RenderGraph::release() {
+	for (auto f = framebuffers.begin(); f != framebuffers.end(); ++f) {
+		GLState::forgetFramebuffer(f->second);
+		glDeleteFramebuffers(1, &f->second);
+	}
+	framebuffers.clear();
+	for (auto t = pool.begin(); t != pool.end(); ++t) {
+		GLState::forgetTexture(t->texture);
+		glDeleteTextures(1, &t->texture);
+	}
+	pool.clear();
+	resources.clear();
+	passes.clear();
+}
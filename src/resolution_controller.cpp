@@ -0,0 +1,41 @@
+#include "resolution_controller.hpp"
+#include <algorithm>
+#include <cmath>
+
+ResolutionController::ResolutionController(double budgetMs, int latency, float minScale, float maxScale) :
+	budgetMs(budgetMs), latency(latency), minScale(minScale), maxScale(maxScale) {
+	current = maxScale;
+	smoothed = maxScale;
+	settle = 0;
+	changeCount = 0;
+}
+
+void ResolutionController::update(double frameMs, double scaledMs) {
+	if (frameMs <= 0.0) return;
+	// Frames rendered before the last change would mislead the estimate
+	if (settle > 0) {
+		settle--;
+		return;
+	}
+
+	// Scale at which the resolution dependent passes take what the rest leaves of the budget
+	float target = maxScale;
+	if (scaledMs > 0.0) {
+		double fullMs = scaledMs / (double(current) * current);
+		double availableMs = budgetMs - (frameMs - scaledMs);
+		target = availableMs > 0.0 ? float(std::sqrt(availableMs / fullMs)) : minScale;
+	}
+	target = std::min(std::max(target, minScale), maxScale);
+
+	// Timer results are noisy, follow them gradually
+	smoothed += (target - smoothed) * 0.25f;
+
+	float step = 1.0f / STEPS;
+	float next = std::floor(smoothed / step) * step;
+	next = std::min(std::max(next, minScale), maxScale);
+	if (next < current || next > current + step) {
+		current = next;
+		settle = latency;
+		changeCount++;
+	}
+}
@@ -0,0 +1,84 @@
+#include "uniform_ring.hpp"
+#include <cstring>
+#include <stdexcept>
+
+UniformRing::UniformRing(GLuint binding, GLsizeiptr blockSize, int slotsPerFrame, int framesInFlight) :
+	binding(binding), blockSize(blockSize), slotsPerFrame(slotsPerFrame), framesInFlight(framesInFlight) {
+	GLint alignment;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	stride = (blockSize + alignment - 1) / alignment * alignment;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, stride * slotsPerFrame * framesInFlight, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	fences.resize(framesInFlight, 0);
+	frame = 0;
+	boundSlot = -1;
+}
+
+void UniformRing::attach(GLuint program, const char* blockName) const {
+	GLuint index = glGetUniformBlockIndex(program, blockName);
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, index, binding);
+}
+
+void UniformRing::update(const void* blocks) {
+	frame = (frame + 1) % framesInFlight;
+	boundSlot = -1;
+
+	// Wait until the GPU is done with this region's previous contents
+	if (fences[frame]) {
+		GLenum status;
+		do status = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		while (status == GL_TIMEOUT_EXPIRED);
+		glDeleteSync(fences[frame]);
+		fences[frame] = 0;
+
+		// If the wait failed, orphan the buffer: the driver allocates new storage
+		// and keeps the old one alive for the draws still reading it
+		if (status == GL_WAIT_FAILED) {
+			glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+			glBufferData(GL_UNIFORM_BUFFER, stride * slotsPerFrame * framesInFlight, NULL, GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			for (auto f = fences.begin(); f != fences.end(); ++f)
+				if (*f) { glDeleteSync(*f); *f = 0; }
+		}
+	}
+
+	// OpenGL 3.3 has no persistent mapping, so the region is mapped for the write only;
+	// the fence makes the unsynchronized mapping safe
+	GLintptr offset = stride * slotsPerFrame * frame;
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	char* dst = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, offset, stride * slotsPerFrame,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!dst) {
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		throw std::runtime_error("UniformRing::update() - Failed to map the uniform buffer");
+	}
+	for (int i = 0; i < slotsPerFrame; i++)
+		memcpy(dst + stride * i, (const char*)blocks + blockSize * i, blockSize);
+	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformRing::bind(int slot) {
+	if (slot == boundSlot) return;
+	GLintptr offset = stride * (slotsPerFrame * frame + slot);
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, blockSize);
+	boundSlot = slot;
+}
+
+void UniformRing::endFrame() {
+	if (fences[frame]) glDeleteSync(fences[frame]);
+	fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// Release resources
+void UniformRing::release() {
+	for (auto f = fences.begin(); f != fences.end(); ++f)
+		if (*f) glDeleteSync(*f);
+	fences.clear();
+	if (buffer) { glDeleteBuffers(1, &buffer); buffer = 0; }
+}
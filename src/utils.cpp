@@ -5,7 +5,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-GLuint compileShader(GLenum type, std::string filename, std::string prepend) {
+std::string loadShaderSource(std::string filename) {
 	// Read the file
 	std::ifstream file(filename);
 	if (!file.is_open()) {
@@ -14,9 +14,19 @@ GLuint compileShader(GLenum type, std::string filename, std::string prepend) {
 		throw std::runtime_error(ss.str());
 	}
 	std::stringstream buffer;
-	buffer << prepend << std::endl;;
 	buffer << file.rdbuf();
-	std::string bufStr = buffer.str();
+	return buffer.str();
+}
+
+GLuint compileShader(GLenum type, std::string filename, std::string prepend) {
+	std::string bufStr = loadShaderSource(filename);
+	// Prepended code goes after the #version directive, which has to come first
+	if (!prepend.empty()) {
+		size_t pos = 0;
+		if (bufStr.compare(0, 8, "#version") == 0)
+			pos = bufStr.find('\n') + 1;
+		bufStr.insert(pos, prepend + "\n");
+	}
 	const char* bufCStr = bufStr.c_str();
 	auto length = GLint(bufStr.length());
 